@@ -5,27 +5,58 @@
 #include "cpu.h"
 #include "ppu.h"
 #include "dma.h"
+#include <algorithm>
 #include <cstdint>
+#include <cstring>
 #include <iostream>
 #include <memory>
+#include <stdexcept>
+#include <type_traits>
 
 #define CONTROLLER_POLL 0x4016
 #define CONTROLLER_POLL2 0x4016
 #define TRIGGER_OAM 0x4014
 
-Bus::Bus() : cpu{this}, ppu{}, dma{this, &ppu}  {}
+// "NESS" in little endian
+#define STATE_MAGIC 0x5353454E
+// needs to go up whenever one of the state structs changes
+#define STATE_VERSION 4
+
+struct StateHeader {
+  uint32_t magic;
+  uint32_t version;
+  uint64_t size;
+};
+
+// the states are copied with memcpy, so they can only hold plain data
+static_assert(std::is_trivially_copyable_v<CpuState>);
+static_assert(std::is_trivially_copyable_v<PpuState>);
+static_assert(std::is_trivially_copyable_v<BusState>);
+static_assert(std::is_trivially_copyable_v<ControllerState>);
+
+Bus::Bus() : cpu{this}, ppu{}, dma{this, &ppu} { map_pages(); }
 
 Bus::~Bus() {}
 
-void Bus::Cpu_write(uint16_t adr, uint8_t data) {
+void Bus::io_write(uint16_t adr, uint8_t data) {
+  // the mapper can switch the CHR banks the PPU is rendering from
+  if (adr >= 0x4020) {
+    sync_ppu();
+    ppu.catch_up();
+  }
+
   // if ever a cartridge read/write operation interferes with
   // a CPU read/write, the cartridge has priority over the CPU
   if (card->cpu_write(adr, data)) {
-  }
-  else if (adr >= 0x0000 && adr <= 0x1FFF) { // the CPU has "mirrors until
-    cpu_ram[adr & 0x07FF] = data;
+    if (card->take_banks_changed()) {
+      map_prg_pages();
+      ppu.map_nametables();
+    }
   } else if (adr >= 0x2000 && adr <= 0x3FFF) {
-    ppu.cpu_write(adr & 0x0007, data);
+    if (ppu_thread)
+      ppu_thread->write(total_clock_count, adr & 0x0007, data);
+    else
+      ppu.cpu_write(adr & 0x0007, data);
   }
   // special register of the CPU called OAMDMA
   // the data it writes to this register (val)
@@ -45,27 +76,14 @@ void Bus::Cpu_write(uint16_t adr, uint8_t data) {
     }
     controller.prev_strobe = strobe;
   }
-  else if (adr >= 0x6000 && adr <= 0x7FFF) {
-    cartridge_ram[adr - 0x6000] = data;
-  }
-
 }
 
-uint8_t Bus::Cpu_read(uint16_t adr, bool bReadOnly) {
-
-  // data that can be read from cartridge as a reference
+uint8_t Bus::io_read(uint16_t adr, bool bReadOnly) {
   uint8_t data{0x00};
 
-  if (card->cpu_read(adr, data)) {
-  } else if (adr >= 0x0000 && adr <= 0x1FFF) {
-    data = cpu_ram[adr & 0x07FF]; // need to do the and operation because of
-                                  // mirroring which just allows the NES to
-                                  // access a single address from multiple
-                                  // different ones (reduces hardware)
-  }
-
   // cpu accessing PPU registers to communicate with it
-  else if (adr >= 0x2000 && adr <= 0x3FFF) {
+  if (adr >= 0x2000 && adr <= 0x3FFF) {
+    sync_ppu();
     return ppu.cpu_read(adr & 0x0007, bReadOnly);
   }
   else if (adr == CONTROLLER_POLL) {
@@ -82,31 +100,238 @@ uint8_t Bus::Cpu_read(uint16_t adr, bool bReadOnly) {
       controller.input.reg >>= 1;
     }
   }
-  else if (adr >= 0x6000 && adr <= 0x7FFF) {
-    data = cartridge_ram[adr - 0x6000];
-  }
 
   return data;
 }
 
 void Bus::oamdma(uint8_t addr) {
+  sync_ppu();
   dma.copy_256(addr);
 }
 
+void Bus::map_pages() {
+  for (int page = 0x00; page <= 0x1F; page++) {
+    // need to do the and operation because of mirroring which just allows
+    // the NES to access a single address from multiple different ones
+    // (reduces hardware)
+    write_map[page] = &cpu_ram[(page & 0x07) << 8];
+    read_map[page] = write_map[page];
+  }
+  for (int page = 0x60; page <= 0x7F; page++) {
+    write_map[page] = &cartridge_ram[(page - 0x60) << 8];
+    read_map[page] = write_map[page];
+  }
+  if (card)
+    map_prg_pages();
+}
+
+void Bus::map_prg_pages() {
+  // the cartridge has priority over the CPU, writes to its pages always go
+  // to the mapper
+  for (int page = 0x80; page <= 0xFF; page++) {
+    read_map[page] = card->prg_page(page);
+    write_map[page] = nullptr;
+  }
+}
+
 void Bus::reset() {
+  sync_ppu();
   total_clock_count = 0;
+  event_count = 0;
   cpu.reset();
+  if (ppu_thread)
+    ppu_thread->rebase(total_clock_count);
+}
+
+void Bus::set_ppu_thread(bool enable) {
+  if (enable == (ppu_thread != nullptr))
+    return;
+  if (enable) {
+    ppu_thread = std::make_unique<PpuThread>(ppu, total_clock_count);
+  } else {
+    sync_ppu();
+    ppu_thread.reset();
+  }
+}
+
+void Bus::schedule(uint64_t cycle, BusEvent type) {
+  if (event_count == MAX_EVENTS)
+    throw std::runtime_error("Too many pending events");
+
+  ScheduledEvent *end = events + event_count;
+  ScheduledEvent *it = std::upper_bound(
+      events, end, cycle,
+      [](uint64_t c, const ScheduledEvent &e) { return c < e.cycle; });
+  std::move_backward(it, end, end + 1);
+  *it = ScheduledEvent{cycle, type};
+  event_count++;
+}
+
+void Bus::service_events() {
+  // the CPU is in the middle of the OAM DMA, which can't be interrupted
+  if (cpu.oam)
+    return;
+
+  uint64_t now = cpu.total_cycles - cpu.cycles;
+  ScheduledEvent *end = events + event_count;
+  for (ScheduledEvent *it = events; it != end && it->cycle <= now; it++) {
+    // a masked IRQ stays pending until the I flag is cleared
+    if (it->type == BusEvent::IRQ && cpu.get_flag(FLAGS::I))
+      continue;
+
+    BusEvent type = it->type;
+    std::move(it + 1, end, it);
+    event_count--;
+    if (type == BusEvent::NMI)
+      cpu.nmi();
+    else
+      cpu.irq();
+    // the interrupt takes the place of the next instruction
+    cpu.total_cycles += cpu.cycles;
+    return;
+  }
 }
 
 void Bus::clock() {
+  if (cpu.complete())
+    service_events();
+
   cpu.clock();
+  if (ppu_thread) {
+    // the PPU is synced every cycle so it can be looked at between them
+    total_clock_count += 3;
+    ppu_thread->sync(total_clock_count);
+    uint64_t nmi_dot;
+    if (ppu_thread->take_nmi(nmi_dot))
+      schedule(cpu.total_cycles - cpu.cycles, BusEvent::NMI);
+    return;
+  }
   for (int i = 0; i < 3; i++) {
-    if (ppu.clock()) cpu.nmi();
+    // the NMI is taken once the current instruction is done
+    if (ppu.clock())
+      schedule(cpu.total_cycles - cpu.cycles, BusEvent::NMI);
     total_clock_count++;
   }
 }
 
+void Bus::run_instruction() {
+  service_events();
+
+  uint64_t start = cpu.total_cycles - cpu.cycles;
+  uint16_t spent = cpu.step();
+  if (ppu_thread) {
+    uint64_t start_dot = total_clock_count;
+    total_clock_count += spent * 3;
+    ppu_thread->run_to(total_clock_count);
+    uint64_t nmi_dot;
+    if (ppu_thread->take_nmi(nmi_dot))
+      schedule(start + (nmi_dot - start_dot) / 3 + 1, BusEvent::NMI);
+    return;
+  }
+  for (int i = 0; i < spent * 3; i++) {
+    // same cycle the event would have been stamped with by clock()
+    if (ppu.clock())
+      schedule(start + i / 3 + 1, BusEvent::NMI);
+  }
+  total_clock_count += spent * 3;
+}
+
+void Bus::run_until(uint64_t target_cycle) {
+  // the memory may have been changed since the last run
+  cpu.forget_idle_loop();
+  // finish what was left over from single stepping with clock()
+  while (!cpu.complete())
+    clock();
+
+  while (cpu.total_cycles < target_cycle)
+    run_instruction();
+}
+
+void Bus::run_frame() {
+  cpu.forget_idle_loop();
+  while (!cpu.complete())
+    clock();
+
+  // the PPU thread always waits for the CPU at the end of a frame
+  while (!(ppu_thread ? ppu_thread->idle() && ppu.frame_complete
+                      : ppu.frame_complete))
+    run_instruction();
+  ppu.frame_complete = false;
+}
+
 void Bus::insert_card(std::unique_ptr<Cartridge> c) {
+  sync_ppu();
   card = std::move(c);
   ppu.connectCard(card.get());
+  card->connect_clock(&cpu.total_cycles);
+  cpu.connect_prg(card->prg_rom());
+  map_pages();
+}
+
+size_t Bus::state_size() const {
+  return sizeof(StateHeader) + sizeof(CpuState) + sizeof(PpuState) +
+         sizeof(BusState) + sizeof(ControllerState) + card->state_size();
+}
+
+void Bus::save_state(uint8_t *buffer) const {
+  sync_ppu();
+  StateHeader header{STATE_MAGIC, STATE_VERSION, state_size()};
+  uint8_t *p = buffer;
+  std::memcpy(p, &header, sizeof(header));
+  p += sizeof(header);
+  std::memcpy(p, static_cast<const CpuState *>(&cpu), sizeof(CpuState));
+  p += sizeof(CpuState);
+  std::memcpy(p, static_cast<const PpuState *>(&ppu), sizeof(PpuState));
+  p += sizeof(PpuState);
+  std::memcpy(p, static_cast<const BusState *>(this), sizeof(BusState));
+  p += sizeof(BusState);
+  std::memcpy(p, static_cast<const ControllerState *>(&controller),
+              sizeof(ControllerState));
+  p += sizeof(ControllerState);
+  card->save_state(p);
+}
+
+void Bus::save_state(std::vector<uint8_t> &buffer) const {
+  buffer.resize(state_size());
+  save_state(buffer.data());
+}
+
+void Bus::load_state(const uint8_t *buffer, size_t size) {
+  StateHeader header;
+  if (size < sizeof(header))
+    throw std::runtime_error("Save state is too small");
+  std::memcpy(&header, buffer, sizeof(header));
+  if (header.magic != STATE_MAGIC)
+    throw std::runtime_error("Not a save state");
+  if (header.version != STATE_VERSION)
+    throw std::runtime_error("Save state is from another version");
+  if (header.size != size || size != state_size())
+    throw std::runtime_error("Save state is not for this game");
+  sync_ppu();
+
+  const uint8_t *p = buffer + sizeof(header);
+  std::memcpy(static_cast<CpuState *>(&cpu), p, sizeof(CpuState));
+  p += sizeof(CpuState);
+  std::memcpy(static_cast<PpuState *>(&ppu), p, sizeof(PpuState));
+  p += sizeof(PpuState);
+  std::memcpy(static_cast<BusState *>(this), p, sizeof(BusState));
+  p += sizeof(BusState);
+  std::memcpy(static_cast<ControllerState *>(&controller), p,
+              sizeof(ControllerState));
+  p += sizeof(ControllerState);
+  card->load_state(p);
+  cpu.forget_idle_loop();
+
+  // the page tables point into the banks of the mapper that was just loaded,
+  // the nametables may be mirrored differently and the CHR RAM has changed
+  card->take_banks_changed();
+  map_prg_pages();
+  ppu.map_nametables();
+  ppu.invalidate_tiles();
+  if (ppu_thread)
+    ppu_thread->rebase(total_clock_count);
+}
+
+void Bus::load_state(const std::vector<uint8_t> &buffer) {
+  load_state(buffer.data(), buffer.size());
 }
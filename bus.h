@@ -6,43 +6,139 @@
 #include "cpu.h"
 #include "ppu.h"
 #include "dma.h"
+#include "ppu_thread.h"
 #include <cstdint>
-#include <fstream>
 #include <cmath>
 #include <memory>
-#include <fstream>
+#include <vector>
 
 // uint16_t has a max value of 2^16 -1 (highest index)
 #define MAX_MEMORY 2048
 #define MAX_CARTRIDGE_RAM 0x2000
 
-class Bus {
+// things that happen to the CPU at a given cycle. They are only acted upon
+// between instructions, so the CPU never has to stop in the middle of one
+enum class BusEvent : uint8_t { NMI, IRQ };
+
+struct ScheduledEvent {
+  uint64_t cycle;
+  BusEvent type;
+};
+
+// only the NMI of a frame and an IRQ are ever waiting at the same time, so
+// this leaves plenty of room
+#define MAX_EVENTS 8
+
+// memory and timing owned by the bus itself, in one plain struct so a save
+// state can copy it in one go
+struct BusState {
+  uint8_t cpu_ram[MAX_MEMORY]{0x00};
+  uint8_t cartridge_ram[MAX_CARTRIDGE_RAM]{0x00};
+
+protected:
+  uint64_t total_clock_count{0};
+  // pending events, kept sorted by cycle
+  ScheduledEvent events[MAX_EVENTS]{};
+  uint8_t event_count{0};
+};
+
+class Bus : public BusState {
 public:
-  std::ofstream debug_out{"debug.txt"};
   Bus();
   ~Bus();
   // CPU reads and writes from the BUS
-  void Cpu_write(uint16_t adr, uint8_t data);
-  uint8_t Cpu_read(uint16_t adr, bool bReadOnly = false);
+  // memory is found through the page tables, everything else (registers and
+  // mapper writes) goes through io_read and io_write
+  void Cpu_write(uint16_t adr, uint8_t data) {
+    uint8_t *page = write_map[adr >> 8];
+    if (page)
+      page[adr & 0xFF] = data;
+    else
+      io_write(adr, data);
+  }
+  uint8_t Cpu_read(uint16_t adr, bool bReadOnly = false) {
+    const uint8_t *page = read_map[adr >> 8];
+    if (page)
+      return page[adr & 0xFF];
+    return io_read(adr, bReadOnly);
+  }
   void oamdma(uint8_t adr);
+  // true if adr is plain memory, which can be read without side effects
+  bool is_memory(uint16_t adr) const { return read_map[adr >> 8]; }
+  // where adr is in memory, nullptr if it isn't plain memory
+  const uint8_t *memory_at(uint16_t adr) const {
+    const uint8_t *page = read_map[adr >> 8];
+    return page ? page + (adr & 0xFF) : nullptr;
+  }
 
   // Devices
   Cpu cpu;
   Ppu ppu;
   Controller controller;
   Dma dma;
-  uint8_t cpu_ram[MAX_MEMORY]{0x00};
-  uint8_t cartridge_ram[MAX_CARTRIDGE_RAM]{0x00};
   std::unique_ptr<Cartridge> card;
   // Interface
   // this function was with a shared_ptr reference, but I don't really see the
   // need, so I've kept it like this for now
   void insert_card(const std::unique_ptr<Cartridge> card);
   void reset();
+  // advances the system by a single CPU cycle, only used for debugging since
+  // it is much slower than run_until
   void clock();
+  // runs whole instructions, catching the PPU up after each one, until the
+  // CPU has reached target_cycle (it can go over by one instruction)
+  void run_until(uint64_t target_cycle);
+  // runs until the PPU has completed a frame
+  void run_frame();
+  // adds an event that is serviced at the first instruction boundary at or
+  // after the given CPU cycle
+  void schedule(uint64_t cycle, BusEvent type);
+  // number of PPU dots since the last reset
+  uint64_t ppu_dots() const { return total_clock_count; }
+  // runs the PPU on a thread of its own, see PpuThread. Outside of the bus
+  // the PPU can still be looked at once run_frame or clock returns
+  void set_ppu_thread(bool enable);
+
+  // save states are a header followed by the state of the CPU, PPU, bus,
+  // controller and mapper, as they are in memory. They are only meant to be
+  // loaded by the same build of the emulator with the same game inserted
+  size_t state_size() const;
+  // buffer has to hold state_size() bytes
+  void save_state(uint8_t *buffer) const;
+  void save_state(std::vector<uint8_t> &buffer) const;
+  // throws if the state is not one saved by save_state for this game
+  void load_state(const uint8_t *buffer, size_t size);
+  void load_state(const std::vector<uint8_t> &buffer);
 
 private:
-  int total_clock_count{0};
+
+  // one entry for each 256 byte page of the CPU address space, pointing
+  // straight to the memory the page is mapped to. Pages without memory
+  // behind them are nullptr
+  const uint8_t *read_map[256]{nullptr};
+  uint8_t *write_map[256]{nullptr};
+
+  // builds the page tables from scratch
+  void map_pages();
+  // points the cartridge pages to the banks currently selected by the mapper
+  void map_prg_pages();
+
+  void io_write(uint16_t adr, uint8_t data);
+  uint8_t io_read(uint16_t adr, bool bReadOnly);
+
+  // services the first event that is due, if there is one
+  void service_events();
+  // runs a single instruction (or interrupt) and the 3 PPU dots per CPU
+  // cycle that happen during it
+  void run_instruction();
+
+  // nullptr when the PPU is run by the thread of the CPU
+  std::unique_ptr<PpuThread> ppu_thread;
+  // waits for the PPU thread to catch up with the CPU, if there is one
+  void sync_ppu() const {
+    if (ppu_thread)
+      ppu_thread->sync(total_clock_count);
+  }
 };
 
 #endif
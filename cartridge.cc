@@ -5,65 +5,21 @@
 #include "mapper_001.h"
 #include <cassert>
 #include <cstdint>
-#include <fstream>
-#include <ios>
 #include <iostream>
 #include <memory>
 #include <stdexcept>
 #include <string>
 
-#define PRG_SIZE 16 * 1024
-#define CHR_SIZE 8 * 1024
-
 Cartridge::~Cartridge() {}
 
-Cartridge::Cartridge(const std::string &file) {
-  std::ifstream ifs{file, std::ios::binary};
-
-  if (!ifs) {
-    throw std::runtime_error("File does not exist.\n");
-  }
-
-  ifs >> header.name[0] >> header.name[1] >> header.name[2] >> header.name[3];
-  ifs >> header.prg_rom_chunks >> header.chr_rom_chunks >> header.mapper1 >>
-      header.mapper2 >> header.prg_ram_size >> header.tv_system1 >>
-      header.tv_system2 >> header.unused[0] >> header.unused[1] >>
-      header.unused[2] >> header.unused[3] >> header.unused[4];
-
-  if (header.name[0] == 'N' && header.name[1] == 'E' && header.name[2] == 'S' &&
-      header.name[3] == 0x1A) {
-    ;
-  } else {
-    throw std::runtime_error("File format is not ines\n");
-  }
-
-  if (header.mapper1 & 0x04)
-    ifs.seekg(512, std::ios::cur);
+Cartridge::Cartridge(const std::string &file)
+    : Cartridge(RomCache::load(file)) {}
 
+Cartridge::Cartridge(std::shared_ptr<const RomImage> rom)
+    : header{rom->header}, rom{std::move(rom)} {
   nMapperID = ((header.mapper2 >> 4) << 4) | (header.mapper1 >> 4);
-
-  // TEMP ADDITION
-  // NOTE: the hardcoded elements are all temporary
-  uint8_t file_type = 1;
-  // header.chr_rom_chunks = 2;
-
-  if (file_type == 0) {
-    // TODO:
-  }
-
-  else if (file_type == 1) {
-    // resizing program and character memory to be right size,
-    // and reading the data from our file
-    nPRGBanks = header.prg_rom_chunks;
-    nCHRBanks = header.chr_rom_chunks;
-    vPRGMemory.resize(nPRGBanks * PRG_SIZE);
-    vCHRMemory.resize(nCHRBanks * CHR_SIZE);
-    ifs.read((char *)vPRGMemory.data(), vPRGMemory.size());
-    ifs.read((char *)vCHRMemory.data(), vCHRMemory.size());
-  }
-  if (file_type == 2) {
-    // TODO:
-  }
+  nPRGBanks = header.prg_rom_chunks;
+  nCHRBanks = header.chr_rom_chunks;
 
   uint8_t argmt = header.mapper1 & 0x01;
   switch (nMapperID) {
@@ -81,18 +37,15 @@ Cartridge::Cartridge(const std::string &file) {
     break;
   }
   assert(mapper.get());
+  map_banks();
 }
 
 // cpu_read will read from the cartridge program memory using the mapper
 bool Cartridge::cpu_read(uint16_t adr, uint8_t &data) {
   uint32_t mapped_adr{0};
-  Mapper_001 *mmc1 = dynamic_cast<Mapper_001 *>(mapper.get());
 
-  if (mmc1)
-    mmc1->prev_written = false;
-
-  if (vPRGMemory.size() > 0 && mapper->cpu_read_mapper(adr, mapped_adr)) {
-    data = vPRGMemory[mapped_adr];
+  if (rom->prg.size() > 0 && mapper->cpu_read_mapper(adr, mapped_adr)) {
+    data = rom->prg[mapped_adr];
 
     return true;
   }
@@ -103,39 +56,56 @@ bool Cartridge::cpu_read(uint16_t adr, uint8_t &data) {
 // cpu_write will write to the cartridge program memory using the mapper
 bool Cartridge::cpu_write(uint16_t adr, uint8_t data) {
   uint32_t mapped_adr{0};
-  Mapper_001 *mmc1 = dynamic_cast<Mapper_001 *>(mapper.get());
-
-  if (mapper->cpu_write_mapper(adr, mapped_adr, data)) {
-    if (mmc1) {
-      mmc1->prev_written = true;
-    }
-    return true;
-  }
-
-  if (mmc1) {
-    mmc1->prev_written = false;
-  }
-  return false;
+  bool mapped = mapper->cpu_write_mapper(adr, mapped_adr, data);
+  if (mapper->banks_changed)
+    map_banks();
+  return mapped;
 }
 
-// ppu_read will read from the cartridge character memory using the mapper
-bool Cartridge::ppu_read(uint16_t adr, uint8_t &data) {
+bool Cartridge::ppu_write(uint16_t adr, uint8_t val) {
   uint32_t mapped_adr{0};
-  if (vCHRMemory.size() > 0 && mapper->ppu_read_mapper(adr, mapped_adr)) {
-    data = vCHRMemory[mapped_adr];
+  if (mapper->ppu_write_mapper(adr, mapped_adr)) {
     return 1;
   }
   return 0;
 }
 
-bool Cartridge::ppu_write(uint16_t adr, uint8_t val) {
+const uint8_t *Cartridge::prg_page(uint8_t page) {
   uint32_t mapped_adr{0};
-  if (mapper->ppu_write_mapper(adr, mapped_adr)) {
-    return 1;
+  if (rom->prg.empty() || !mapper->cpu_read_mapper(page << 8, mapped_adr))
+    return nullptr;
+
+  // banks are at least 16KB, so a page never crosses the end of the memory.
+  // Bank numbers past the end of the ROM wrap around
+  return &rom->prg[mapped_adr % rom->prg.size()];
+}
+
+void Cartridge::map_banks() {
+  for (int page = 0; page < 8; page++) {
+    uint32_t mapped_adr{0};
+    if (rom->chr.empty() || !mapper->ppu_read_mapper(page << 10, mapped_adr))
+      chr_map[page] = nullptr;
+    else
+      chr_map[page] = &rom->chr[mapped_adr % rom->chr.size()];
   }
-  return 0;
+  argmt = mapper->get_name_tbl_argmt();
+}
+
+bool Cartridge::take_banks_changed() {
+  bool changed = mapper->banks_changed;
+  mapper->banks_changed = false;
+  return changed;
 }
 
-const Arangement Cartridge::get_argmt() const {
-  return mapper->get_name_tbl_argmt();
+void Cartridge::connect_clock(const uint64_t *cycles) {
+  mapper->connect_clock(cycles);
+}
+
+size_t Cartridge::state_size() const { return mapper->state_size(); }
+
+void Cartridge::save_state(uint8_t *dst) const { mapper->save_state(dst); }
+
+void Cartridge::load_state(const uint8_t *src) {
+  mapper->load_state(src);
+  map_banks();
 }
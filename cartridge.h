@@ -3,27 +3,17 @@
 
 #include "mapper.h"
 #include "mapper_000.h"
+#include "rom.h"
 #include <cstdint>
 #include <memory>
 #include <string>
 #include <vector>
 
-struct sHeader {
-  char name[4];
-  uint8_t prg_rom_chunks;
-  uint8_t chr_rom_chunks;
-  uint8_t mapper1;
-  uint8_t mapper2;
-  uint8_t prg_ram_size;
-  uint8_t tv_system1;
-  uint8_t tv_system2;
-  char unused[5];
-};
-
 class Cartridge {
 
 public:
   Cartridge(const std::string &file);
+  Cartridge(std::shared_ptr<const RomImage> rom);
   ~Cartridge();
 
   sHeader header;
@@ -33,19 +23,48 @@ public:
   // cartridge
   bool cpu_read(uint16_t adr, uint8_t &data);
   bool cpu_write(uint16_t adr, uint8_t data);
-  bool ppu_read(uint16_t adr, uint8_t &data);
+  // the PPU reads the pattern memory for every tile, so it goes straight
+  // through the CHR pages instead of asking the mapper
+  bool ppu_read(uint16_t adr, uint8_t &data) {
+    const uint8_t *page = adr < 0x2000 ? chr_map[adr >> 10] : nullptr;
+    if (!page)
+      return false;
+    data = page[adr & 0x03FF];
+    return true;
+  }
   bool ppu_write(uint16_t adr, uint8_t val);
 
-  const Arangement get_argmt() const;
+  const Arangement get_argmt() const { return argmt; }
+  // the CHR memory at the given 1KB page of the pattern memory, nullptr if
+  // the cartridge doesn't map it
+  const uint8_t *chr_page(uint8_t page) const { return chr_map[page]; }
+  void connect_clock(const uint64_t *cycles);
+  // the mapper registers, see Mapper::save_state
+  size_t state_size() const;
+  void save_state(uint8_t *dst) const;
+  void load_state(const uint8_t *src);
 
-  // NOTE: vPRGMemory should be private
-  std::vector<uint8_t> vPRGMemory; // 16 KB
+  // pointer to the PRG memory the CPU sees at the given 256 byte page, or
+  // nullptr if the mapper doesn't map that page
+  const uint8_t *prg_page(uint8_t page);
+  // the whole PRG ROM, prg_page always points into it
+  std::span<const uint8_t> prg_rom() const { return rom->prg; }
+  // true if the banks were switched since the last call
+  bool take_banks_changed();
 
   std::unique_ptr<Mapper> mapper;
   // Cartridge is connected to CPU and PPU through a NOTE: mapper
   // The mapper is set up by the CPU and
 private:
-  std::vector<uint8_t> vCHRMemory; // 8KB
+  // PRG and CHR ROM, shared with the other cartridges of the same game
+  std::shared_ptr<const RomImage> rom;
+
+  // what the mapper currently selects, copied out of it whenever it switches
+  // banks so the PPU doesn't have to go through the mapper. One CHR pointer
+  // per 1KB, nullptr where the mapper doesn't map anything
+  const uint8_t *chr_map[8]{nullptr};
+  Arangement argmt{Arangement::VERTICAL};
+  void map_banks();
 
   int mapper_type;
   uint8_t nMapperID = 0;
@@ -1,8 +1,12 @@
 #ifndef CONTROLLER_H
 #define CONTROLLER_H
 
+#include <atomic>
 #include <cstdint>
-struct Controller {
+
+// what the game sees of the controller, kept apart from the buttons the front
+// end publishes so it can be saved with the rest of the machine
+struct ControllerState {
   union Input {
     uint8_t reg;
     struct {
@@ -15,12 +19,23 @@ struct Controller {
       uint8_t left: 1;
       uint8_t right: 1;
     };
-  } input;
+  } input{};
   int shifted_count = 0;
   bool prev_strobe = false;
+};
+
+struct Controller : ControllerState {
+
+  // the front end publishes the buttons that are pressed here, from any
+  // thread. The game sees them the next time it strobes the controller
+  void set_buttons(uint8_t buttons) {
+    latest.store(buttons, std::memory_order_relaxed);
+  }
 
   void detect_input();
-  void detect_input_keyboard();
+
+private:
+  std::atomic<uint8_t> latest{0x00};
 };
 
 #endif
@@ -1,3 +1,4 @@
+#include <array>
 #include <cstdint>
 #include <ios>
 #include <iostream> // for debugging
@@ -10,10 +11,13 @@
 
 #define DEBUG_CPU false
 
-Cpu::Cpu(Bus *bus) : bus{bus} {
+namespace {
+// the names and addressing modes of the instructions, only used by the
+// disassembler
+std::vector<Cpu::INSTRUCTION> build_lookup() {
   using a = Cpu;
 
-  lookup = {
+  return {
       {"BRK", &a::imp},       {"ORA", &a::ind_X},     {"???", &a::imp},
       {"???", &a::imp},       {"???", &a::imp},       {"ORA", &a::zpg},
       {"ASL", &a::zpg},       {"???", &a::imp},       {"PHP", &a::imp},
@@ -102,1137 +106,532 @@ Cpu::Cpu(Bus *bus) : bus{bus} {
       {"???", &a::imp},
   };
 }
+} // namespace
+
+// the same for every CPU, so it is only built once
+const std::vector<Cpu::INSTRUCTION> Cpu::lookup = build_lookup();
+
+Cpu::Cpu(Bus *bus) : bus{bus} {}
 
 Cpu::~Cpu() {}
 
-void Cpu::write(uint16_t adr, uint8_t val) { bus->Cpu_write(adr, val); }
+void Cpu::write(uint16_t adr, uint8_t val) {
+  // the memory an idle loop reads may have changed
+  idle_mode = IdleMode::NONE;
+  bus->Cpu_write(adr, val);
+}
 
 uint8_t Cpu::read(uint16_t adr) const { return bus->Cpu_read(adr); }
 
-// get the flag at the specific bit from status
-uint8_t Cpu::get_flag(FLAGS flag) const {
+// set bit corresponding to the flag in our status to 0 if on == false
+// or 1 otherwise
+void Cpu::set_flag(FLAGS flag, bool on) {
   switch (flag) {
   case FLAGS::C:
-    return FLAGS::C & status;
+    carry = on;
     break;
   case FLAGS::Z:
-    return FLAGS::Z & status;
-    break;
-  case FLAGS::I:
-    return FLAGS::I & status;
-    break;
-  case FLAGS::D:
-    return FLAGS::D & status;
-    break;
-  case FLAGS::B:
-    return FLAGS::B & status;
-    break;
-  case FLAGS::U:
-    return FLAGS::U & status;
+    z_result = on ? 0x00 : 0x01;
     break;
   case FLAGS::V:
-    return FLAGS::V & status;
+    overflow = on;
     break;
   case FLAGS::N:
-    return FLAGS::N & status;
-    break;
-  default:
-    throw std::runtime_error("Invalid flag");
-  }
-}
-
-// set bit corresponding to the flag in our status to 0 if on == false
-// or 1 otherwise
-void Cpu::set_flag(FLAGS flag, bool on) {
-  switch (flag) {
-  case FLAGS::C: {
-    uint8_t mask = 1;
-    if (!on)
-      status = status & ~mask;
-    else
-      status = status | mask;
-    break;
-  }
-  case FLAGS::Z: {
-    uint8_t mask = 1 << 1;
-    if (!on)
-      status = status & ~mask;
-    else
-      status = status | mask;
-    break;
-  }
-  case FLAGS::I: {
-    uint8_t mask = 1 << 2;
-    if (!on)
-      status = status & ~mask;
-    else
-      status = status | mask;
-    break;
-  }
-  case FLAGS::D: {
-    uint8_t mask = 1 << 3;
-    if (!on)
-      status = status & ~mask;
-    else
-      status = status | mask;
-    break;
-  }
-  case FLAGS::B: {
-    uint8_t mask = 1 << 4;
-    if (!on)
-      status = status & ~mask;
-    else
-      status = status | mask;
-    break;
-  }
-  case FLAGS::U: {
-    uint8_t mask = 1 << 5;
-    if (!on)
-      status = status & ~mask;
-    else
-      status = status | mask;
+    n_result = on ? 0x80 : 0x00;
     break;
-  }
-  case FLAGS::V: {
-    uint8_t mask = 1 << 6;
-    if (!on)
-      status = status & ~mask;
-    else
-      status = status | mask;
-    break;
-  }
-  case FLAGS::N: {
-    uint8_t mask = 1 << 7;
+  case FLAGS::I:
+  case FLAGS::D:
+  case FLAGS::B:
+  case FLAGS::U:
     if (!on)
-      status = status & ~mask;
+      status_idbu = status_idbu & ~flag;
     else
-      status = status | mask;
+      status_idbu = status_idbu | flag;
     break;
-  }
   default:
     throw std::runtime_error("Invalid flag");
   }
 }
 
+uint8_t Cpu::get_status() const {
+  return status_idbu | get_flag(FLAGS::C) | get_flag(FLAGS::Z) |
+         get_flag(FLAGS::V) | get_flag(FLAGS::N);
+}
+
+void Cpu::set_status(uint8_t status) {
+  status_idbu = status & (FLAGS::I | FLAGS::D | FLAGS::B | FLAGS::U);
+  set_flag(FLAGS::C, status & FLAGS::C);
+  set_flag(FLAGS::Z, status & FLAGS::Z);
+  set_flag(FLAGS::V, status & FLAGS::V);
+  set_flag(FLAGS::N, status & FLAGS::N);
+}
+
 uint8_t Cpu::fetch() {
   fetched = read(adr);
   return fetched;
 }
 
-void Cpu::clock() {
-  // if we finished the previous instruction, execute new one
-  // unlike real hardware, we finish the instruction in a single cycle
-  // then wait out the cycles until they reach 0
-  if (cycles == 0 && !oam) {
-    opcode = read(PC);
-
-    set_flag(FLAGS::U, 1);
-    PC++;
-
-    // can have 1 or 0 additional cycle
-    uint8_t additional_cycle = execute_opcode(static_cast<Opcode>(opcode));
+void Cpu::start_instruction() {
+  if (!oam) {
+    status_idbu |= FLAGS::U;
+
+    // can have 1 or 0 additional cycle. Code in PRG ROM runs from the
+    // decoded instructions, anything else can change and is decoded every
+    // time
+    uint8_t additional_cycle;
+    const uint8_t *code = bus->memory_at(PC);
+    if (code >= prg_rom.data() && code < prg_rom.data() + prg_rom.size()) {
+      additional_cycle = run_from_cache(code);
+    } else {
+      opcode = read(PC);
+      PC++;
+      additional_cycle = execute_opcode(static_cast<Opcode>(opcode));
+    }
 
     cycles += additional_cycle;
     total_cycles += cycles;
-    set_flag(FLAGS::U, 1);
-  } else if (cycles == 0) {
+    status_idbu |= FLAGS::U;
+  } else {
     // TODO: not exactly cycle accurate because it could have 514 cycles
     // but for doing this it would have to be cycle accurate
     cycles += 513;
     total_cycles += 513;
     oam = false;
   }
-
-  clock_count++;
-  cycles--;
 }
 
-bool Cpu::complete() const { return cycles == 0; }
-
-uint8_t Cpu::execute_opcode(Opcode opcode) {
-  uint8_t additional = 0x00;
-  uint8_t op_result = 0x00;
-  switch (opcode) {
-  case Opcode::BRK: {
-    PC++;
-
-    cycles = 7;
-    push(get_high(PC));
-    push(get_low(PC));
-
-    set_flag(FLAGS::I, 1);
-    set_flag(FLAGS::B, 1);
-    push(status);
-    set_flag(FLAGS::B, 0);
-
-    uint16_t new_adr = convertTo_16_bit(read(0xFFFF), read(0xFFFE));
-    PC = new_adr;
-    break;
-  }
-  case Opcode::BPL: {
-    cycles = 2;
-    additional = relative();
-
-    if (get_flag(FLAGS::N) == 0) {
-      cycles++;
-
-      adr = PC + adr_relative;
-
-      // if high bytes are affected we add a cycle (not sure why)
-      if ((adr & 0xFF00) != (PC & 0xFF00))
-        cycles++;
-
-      PC = adr;
-    }
-
-    op_result = 0;
-    break;
-  }
-  case Opcode::JSR: {
-    cycles = 6;
-    additional = absolute();
-    PC--;
-    push(get_high(PC));
-    push(get_low(PC));
-    fetch();
-    PC = adr;
-    break;
-  }
-  case Opcode::BMI: {
-    cycles = 2;
-    additional = relative();
-
-    if (get_flag(FLAGS::N)) {
-      cycles++;
-
-      adr = PC + adr_relative;
-
-      // if high bytes are affected we add a cycle (not sure why)
-      if ((adr & 0xFF00) != (PC & 0xFF00))
-        cycles++;
-
-      PC = adr;
-    }
-
-    op_result = 0;
-    break;
-  }
-  case Opcode::RTI: {
-    cycles = 6;
-    status = pull();
-
-    status &= ~FLAGS::B;
-    status &= ~FLAGS::U;
-
-    uint8_t low = pull();
-    uint8_t high = pull();
-
-    PC = convertTo_16_bit(high, low);
-    break;
-  }
-  case Opcode::BVC: {
-    cycles = 2;
-    additional = relative();
-
-    if (get_flag(FLAGS::V) == 0) {
-      cycles++;
-
-      adr = PC + adr_relative;
-
-      // if high bytes are affected we add a cycle (not sure why)
-      if ((adr & 0xFF00) != (PC & 0xFF00))
-        cycles++;
-
-      PC = adr;
-    }
-
-    op_result = 0;
-    break;
-  }
-  case Opcode::RTS: {
-    cycles = 6;
-    uint8_t low = pull();
-    uint8_t high = pull();
-
-    PC = convertTo_16_bit(high, low) + 1;
-    break;
-  }
-  case Opcode::BVS: {
-    cycles = 2;
-    additional = relative();
-
-    if (get_flag(FLAGS::V)) {
-      cycles++;
-
-      adr = PC + adr_relative;
-
-      // if high bytes are affected we add a cycle (not sure why)
-      if ((adr & 0xFF00) != (PC & 0xFF00))
-        cycles++;
-
-      PC = adr;
-    }
-
-    op_result = 0;
-    break;
+void Cpu::clock() {
+  // if we finished the previous instruction, execute new one
+  // unlike real hardware, we finish the instruction in a single cycle
+  // then wait out the cycles until they reach 0
+  if (cycles == 0) {
+    // only step keeps track of where an idle loop is
+    idle_mode = IdleMode::NONE;
+    start_instruction();
   }
-  case Opcode::BCC: {
-    cycles = 2;
-    additional = relative();
 
-    if (!get_flag(FLAGS::C)) {
-      cycles++;
-
-      adr = PC + adr_relative;
-
-      // if high bytes are affected we add a cycle (not sure why)
-      if ((adr & 0xFF00) != (PC & 0xFF00))
-        cycles++;
+  clock_count++;
+  cycles--;
+}
 
-      PC = adr;
+uint16_t Cpu::step() {
+  // cycles left over by an interrupt are spent instead of a new instruction
+  if (cycles == 0) {
+    if (idle_mode == IdleMode::REPLAYING) {
+      if (PC == idle_steps[idle_next].pc)
+        return replay_idle_step();
+      idle_mode = IdleMode::NONE;
     }
 
-    op_result = 0;
-    break;
+    uint16_t pc = PC;
+    start_instruction();
+    if (idle_mode == IdleMode::RECORDING)
+      record_idle_step(pc);
+    else if (PC <= pc)
+      find_idle_loop(pc);
   }
-  case Opcode::LD_immY: {
-    cycles = 2;
 
-    uint8_t val = read(PC++);
+  uint16_t spent = cycles;
+  clock_count += spent;
+  cycles = 0;
+  return spent;
+}
 
-    y = val;
+bool Cpu::complete() const { return cycles == 0; }
 
-    update_y_flags();
+uint8_t Cpu::idle_instruction(uint16_t pc) const {
+  if (!bus->is_memory(pc))
     return 0;
-  }
-  case Opcode::BCS: {
-    cycles = 2;
-
-    additional = relative();
-    op_result = BCS();
-    break;
-  }
-  case Opcode::CP_immY: {
-    cycles = 2;
-    uint8_t val = read(PC++);
-
-    uint8_t res = y - val;
-
-    set_flag(FLAGS::Z, res == 0x00);
-    set_flag(FLAGS::C, y >= val);
-    set_flag(FLAGS::N, res >> 7 == 1);
-    break;
-  }
-  case Opcode::BNE: {
-    cycles = 2;
-    additional = relative();
-
-    if (!get_flag(FLAGS::Z)) {
-      cycles++;
-
-      adr = PC + adr_relative;
-
-      // if high bytes are affected we add a cycle (not sure why)
-      if ((adr & 0xFF00) != (PC & 0xFF00))
-        cycles++;
-
-      PC = adr;
-    }
-
-    op_result = 0;
-    break;
-  }
-  case Opcode::CP_immX: {
-    cycles = 2;
-    uint8_t val = read(PC++);
-
-    uint8_t res = x - val;
-
-    set_flag(FLAGS::Z, res == 0x00);
-    set_flag(FLAGS::C, x >= val);
-    set_flag(FLAGS::N, res >> 7 == 1);
-    break;
-  }
-  case Opcode::BEQ: {
-    cycles = 2;
-    additional = relative();
-
-    if (get_flag(FLAGS::Z)) {
-      cycles++;
-
-      adr = PC + adr_relative;
-
-      // if high bytes are affected we add a cycle (not sure why)
-      if ((adr & 0xFF00) != (PC & 0xFF00))
-        cycles++;
-
-      PC = adr;
-    }
-
-    op_result = 0;
-    break;
-  }
-  case Opcode::ORA_indX:
-    cycles = 6;
-    additional = ind_X();
-    op_result = ORA();
-    break;
-  case Opcode::ORA_indY:
-    cycles = 5;
-    additional = ind_Y();
-    op_result = ORA();
-    break;
-  case Opcode::AND_indX:
-    cycles = 6;
-    additional = ind_X();
-    op_result = AND();
-    break;
-  case Opcode::AND_indY:
-    cycles = 5;
-    additional = ind_Y();
-    op_result = AND();
-    break;
-  case Opcode::EOR_indX:
-    additional = ind_X();
-    op_result = EOR();
-    cycles = 6;
-    break;
-  case Opcode::EOR_indY:
-    cycles = 5;
-    additional = ind_Y();
-    op_result = EOR();
-    break;
-  case Opcode::ADC_indX:
-    cycles = 6;
-    additional = ind_X();
-    op_result = ADC();
-    break;
-  case Opcode::ADC_indY:
-    cycles = 5;
-    additional = ind_Y();
-    op_result = ADC();
-    break;
-  case Opcode::STA_indX:
-    cycles = 6;
-    additional = ind_X();
-    op_result = STA();
-    break;
-  case Opcode::STA_indY:
-    cycles = 6;
-    additional = ind_Y();
-    op_result = STA();
-    break;
-  case Opcode::LDA_indX:
-    cycles = 6;
-    additional = ind_X();
-    op_result = LDA();
-    break;
-  case Opcode::LDA_indY:
-    cycles = 5;
-    additional = ind_Y();
-    op_result = LDA();
-    break;
-  case Opcode::CMP_indX:
-    cycles = 6;
-    additional = ind_X();
-    op_result = CMP();
-    break;
-  case Opcode::CMP_indY:
-    cycles = 5;
-    additional = ind_Y();
-    op_result = CMP();
-    break;
-  case Opcode::SBC_indX:
-    cycles = 6;
-    additional = ind_X();
-    op_result = SBC();
-    break;
-  case Opcode::SBC_indY:
-    cycles = 5;
-    additional = ind_Y();
-    op_result = SBC();
-    break;
-  case Opcode::LD_immX: {
-    cycles = 2;
-    uint8_t val = read(PC++);
-
-    x = val;
 
-    update_x_flags();
-
-    return 0;
-  }
-  case Opcode::BIT_zpg:
-    cycles = 3;
-    additional = zpg();
-    op_result = BIT();
-    break;
-  case Opcode::ST_zpgY:
-    cycles = 3;
-    additional = zpg();
-    op_result = STY();
-    break;
-  case Opcode::ST_zpgYX:
-    cycles = 4;
-    additional = zpgX();
-    op_result = STY();
-    break;
+  uint16_t operand = bus->Cpu_read(pc + 1, true);
+  switch (static_cast<Opcode>(bus->Cpu_read(pc, true))) {
+  // loads, compares and logic on memory that doesn't change
+  case Opcode::LDA_abs:
+  case Opcode::LDX_abs:
+  case Opcode::LDY_abs:
+  case Opcode::CMP_abs:
+  case Opcode::CP_absX:
+  case Opcode::CP_absY:
+  case Opcode::BIT_abs:
+  case Opcode::AND_abs:
+  case Opcode::ORA_abs:
+  case Opcode::EOR_abs:
+    operand |= bus->Cpu_read(pc + 2, true) << 8;
+    // registers have side effects when read
+    return bus->is_memory(operand) ? 3 : 0;
+  case Opcode::JMP_abs:
+    return 3;
+  case Opcode::LDA_zpg:
+  case Opcode::LDX_zpg:
   case Opcode::LD_zpgY:
-    cycles = 3;
-    additional = zpg();
-    op_result = LDY();
-    break;
-  case Opcode::LD_zpgYX:
-    cycles = 4;
-    additional = zpgX();
-    op_result = LDY();
-    break;
-  case Opcode::CP_zpgY:
-    cycles = 3;
-    additional = zpg();
-    op_result = CPY();
-    break;
+  case Opcode::CMP_zpg:
   case Opcode::CP_zpgX:
-    cycles = 3;
-    additional = zpg();
-    op_result = CPX();
-    break;
-  case Opcode::ORA_zpg:
-    cycles = 3;
-    additional = zpg();
-    op_result = ORA();
-    break;
-  case Opcode::ORA_zpgX:
-    cycles = 4;
-    additional = zpgX();
-    op_result = ORA();
-    break;
+  case Opcode::CP_zpgY:
+  case Opcode::BIT_zpg:
   case Opcode::AND_zpg:
-    cycles = 3;
-    additional = zpg();
-    op_result = AND();
-    break;
-  case Opcode::AND_zpgX:
-    cycles = 4;
-    additional = zpgX();
-    op_result = AND();
-    break;
+  case Opcode::ORA_zpg:
   case Opcode::EOR_zpg:
-    cycles = 3;
-    additional = zpg();
-    op_result = EOR();
-    break;
-  case Opcode::EOR_zpgX:
-    cycles = 4;
-    additional = zpgX();
-    op_result = EOR();
-    break;
-  case Opcode::ADC_zpg:
-    cycles = 3;
-    additional = zpg();
-    op_result = ADC();
-    break;
-  case Opcode::ADC_zpgX:
-    cycles = 4;
-    additional = zpgX();
-    op_result = ADC();
-    break;
-  case Opcode::STA_zpg:
-    cycles = 3;
-    additional = zpg();
-    op_result = STA();
-    break;
-  case Opcode::STA_zpgX:
-    cycles = 4;
-    additional = zpgX();
-    op_result = STA();
-    break;
-  case Opcode::LDA_zpg:
-    cycles = 3;
-    additional = zpg();
-    op_result = LDA();
-    break;
-  case Opcode::LDA_zpgX:
-    cycles = 4;
-    additional = zpgX();
-    op_result = LDA();
-    break;
-  case Opcode::CMP_zpg:
-    cycles = 3;
-    additional = zpg();
-    op_result = CMP();
-    break;
-  case Opcode::CMP_zpgX:
-    cycles = 4;
-    additional = zpgX();
-    op_result = CMP();
-    break;
-  case Opcode::SBC_zpg:
-    cycles = 3;
-    additional = zpg();
-    op_result = SBC();
-    break;
-  case Opcode::SBC_zpgX:
-    cycles = 4;
-    additional = zpgX();
-    op_result = SBC();
-    break;
-  case Opcode::ASL_zpg:
-    cycles = 5;
-    additional = zpg();
-    op_result = ASL();
-    break;
-  case Opcode::ASL_zpgX:
-    cycles = 6;
-    additional = zpgX();
-    op_result = ASL();
-    break;
-  case Opcode::ROL_zpg:
-    cycles = 5;
-    additional = zpg();
-    op_result = ROL();
-    break;
-  case Opcode::ROL_zpgX:
-    cycles = 6;
-    additional = zpgX();
-    op_result = ROL();
-    break;
-  case Opcode::LSR_zpg:
-    cycles = 5;
-    additional = zpg();
-    op_result = LSR();
-    break;
-  case Opcode::LSR_zpgX:
-    cycles = 6;
-    additional = zpgX();
-    op_result = LSR();
-    break;
-  case Opcode::ROR_zpg:
-    cycles = 5;
-    additional = zpg();
-    op_result = ROR();
-    break;
-  case Opcode::ROR_zpgX:
-    cycles = 6;
-    additional = zpgX();
-    op_result = ROR();
-    break;
-  case Opcode::STX_zpg:
-    cycles = 3;
-    additional = zpg();
-    op_result = STX();
-    break;
-  case Opcode::STX_zpgY:
-    cycles = 4;
-    additional = zpgY();
-    op_result = STX();
-    break;
-  case Opcode::LDX_zpg:
-    cycles = 3;
-    additional = zpg();
-    op_result = LDX();
-    break;
-  case Opcode::LDX_zpgY:
-    cycles = 4;
-    additional = zpgY();
-    op_result = LDX();
-    break;
-  case Opcode::DEC_zpg:
-    cycles = 5;
-    additional = zpg();
-    op_result = DEC();
-    break;
-  case Opcode::DEC_zpgX:
-    cycles = 6;
-    additional = zpgX();
-    op_result = DEC();
-    break;
-  case Opcode::INC_zpg:
-    cycles = 5;
-    additional = zpg();
-    op_result = INC();
-    break;
-  case Opcode::INC_zpgX:
-    cycles = 6;
-    additional = zpgX();
-    op_result = INC();
-    break;
-  case Opcode::PHP_impl:
-    cycles = 3;
-    push(status | 0x30);
-    break;
+  case Opcode::LDA_imm:
+  case Opcode::LD_immX:
+  case Opcode::LD_immY:
+  case Opcode::CMP_imm:
+  case Opcode::CP_immX:
+  case Opcode::CP_immY:
+  case Opcode::AND_imm:
+  case Opcode::ORA_imm:
+  case Opcode::EOR_imm:
+  case Opcode::BPL:
+  case Opcode::BMI:
+  case Opcode::BVC:
+  case Opcode::BVS:
+  case Opcode::BCC:
+  case Opcode::BCS:
+  case Opcode::BNE:
+  case Opcode::BEQ:
+    return 2;
+  case Opcode::TAX_impl:
+  case Opcode::TAY_impl:
+  case Opcode::TXA_impl:
+  case Opcode::TYA_impl:
   case Opcode::CLC_impl:
-    cycles = 2;
-    set_flag(FLAGS::C, 0);
-    break;
-  case Opcode::PLP_impl: {
-    cycles = 4;
-    uint8_t new_status = pull();
-    status = new_status & (0b11001111);
-    break;
-  }
   case Opcode::SEC_impl:
-    cycles = 2;
-    set_flag(FLAGS::C, 1);
-    break;
-  case Opcode::PHA_impl:
-    cycles = 3;
-    push(accumulator);
-    break;
-  case Opcode::CLI_impl:
-    cycles = 2;
-    set_flag(FLAGS::I, 0);
-    break;
-  case Opcode::PLA_impl:
-    cycles = 4;
-    accumulator = pull();
-    update_accumulator_flags();
-    break;
-  case Opcode::SEI_impl:
-    cycles = 2;
-    set_flag(FLAGS::I, 1);
-    break;
-  case Opcode::DEY_impl:
-    cycles = 2;
-    y -= 1;
-
-    update_y_flags();
-    return 0;
-  case Opcode::TYA_impl:
-    cycles = 2;
-    accumulator = y;
-    update_accumulator_flags();
-    break;
-  case Opcode::TAY_impl:
-    cycles = 2;
-    y = accumulator;
-    update_y_flags();
-    break;
   case Opcode::CLV_impl:
-    cycles = 2;
-    set_flag(FLAGS::V, 0);
-    break;
-  case Opcode::INY_impl:
-    cycles = 2;
-    y += 1;
-    update_y_flags();
-    break;
-  case Opcode::CLD_impl:
-    cycles = 2;
-    set_flag(FLAGS::D, 0);
-    break;
-  case Opcode::INX_impl:
-    cycles = 2;
-    x += 1;
-    update_x_flags();
-    break;
-  case Opcode::SED_impl:
-    cycles = 2;
-    set_flag(FLAGS::D, 1);
-    break;
-  case Opcode::ORA_imm: {
-    cycles = 2;
-    uint8_t val = read(PC++);
-
-    accumulator |= val;
-
-    update_accumulator_flags();
-
+  case Opcode::NOP_impl:
+    return 1;
+  default:
     return 0;
   }
-  case Opcode::ORA_absY: {
-    cycles = 4;
-    additional = absoluteY();
-    op_result = ORA();
-    break;
-  }
-  case Opcode::AND_imm: {
-    cycles = 2;
-    uint8_t val = read(PC++);
-    accumulator = accumulator & val;
-    update_accumulator_flags();
+}
 
-    return 0;
-    break;
+void Cpu::find_idle_loop(uint16_t pc) {
+  uint32_t loop = (PC << 16) | pc;
+  if (pc - PC >= IDLE_LOOP_BYTES || loop == idle_rejected)
+    return;
+
+  // every instruction from the start of the loop to the jump back has to be
+  // one that only reads
+  uint16_t at = PC;
+  while (at < pc) {
+    uint8_t size = idle_instruction(at);
+    if (size == 0)
+      break;
+    at += size;
   }
-  case Opcode::AND_absY:
-    cycles = 4;
-    additional = absoluteY();
-    op_result = AND();
-    break;
-  case Opcode::EOR_imm: {
-    cycles = 2;
-    accumulator = accumulator ^ read(PC++);
-    update_accumulator_flags();
-    break;
+  if (at != pc || idle_instruction(pc) == 0) {
+    // busy loops jump back on every iteration, no need to look at them again
+    idle_rejected = loop;
+    return;
   }
-  case Opcode::EOR_absY:
-    cycles = 4;
-    additional = absoluteY();
-    op_result = EOR();
-    break;
-  case Opcode::ADC_imm: {
-    cycles = 2;
-    uint8_t val = read(PC++);
-
-    uint16_t temp = static_cast<uint16_t>(val) +
-                    static_cast<uint16_t>(accumulator) + get_flag(FLAGS::C);
 
-    set_flag(FLAGS::C, temp > 255);
-    set_flag(FLAGS::Z, (temp & 0x00FF) == 0);
-    set_flag(FLAGS::N, temp & 0x80);
-    set_flag(
-        FLAGS::V,
-        (~(static_cast<uint16_t>(accumulator) ^ static_cast<uint16_t>(val)) &
-         (static_cast<uint16_t>(accumulator) ^ static_cast<uint16_t>(temp))) &
-            0x0080);
-
-    accumulator = temp & 0x00FF;
+  idle_mode = IdleMode::RECORDING;
+  idle_count = 0;
+  idle_start = PC;
+  idle_end = pc;
+  idle_head = *this;
+}
 
-    return 0;
+void Cpu::record_idle_step(uint16_t pc) {
+  // the loop was left, or is longer than it looked
+  if (pc < idle_start || pc > idle_end || idle_count == IDLE_LOOP_STEPS) {
+    idle_mode = IdleMode::NONE;
+    return;
   }
-  case Opcode::ADC_absY:
-    cycles = 4;
-    additional = absoluteY();
-    op_result = ADC();
-    break;
-  case Opcode::STA_absY:
-    cycles = 5;
-    additional = absoluteY();
-    op_result = STA();
-    break;
-  case Opcode::LDA_imm: {
-    cycles = 2;
-    accumulator = read(PC++);
-    update_accumulator_flags();
 
-    return 0;
-  }
-  case Opcode::LDA_absY:
-    cycles = 4;
-    additional = absoluteY();
-    op_result = LDA();
-    break;
-  case Opcode::CMP_imm: {
-    cycles = 2;
-    uint8_t val = read(PC++);
-    uint16_t temp = (uint16_t)accumulator - (uint16_t)val;
-    set_flag(C, accumulator >= val);
-    set_flag(Z, (temp & 0x00FF) == 0x0000);
-    set_flag(N, temp & 0x0080);
-    return 0;
-  }
-  case Opcode::CMP_absY:
-    cycles = 4;
-    additional = absoluteY();
-    op_result = CMP();
-    break;
-  case Opcode::SBC_imm: {
-    cycles = 2;
-    uint16_t val = read(PC++) ^ 0x00FF;
+  IdleStep &step = idle_steps[idle_count++];
+  step.pc = pc;
+  step.cycles = cycles;
+  step.after = *this;
+  step.after.cycles = 0;
+
+  if (pc != idle_end || PC != idle_start)
+    return;
+
+  // back at the start, it only is an idle loop if nothing changed
+  const CpuState &a = idle_head;
+  bool same = a.accumulator == accumulator && a.x == x && a.y == y &&
+              a.stack_pointer == stack_pointer &&
+              a.status_idbu == status_idbu && a.n_result == n_result &&
+              a.z_result == z_result && a.carry == carry &&
+              a.overflow == overflow && a.fetched == fetched &&
+              a.opcode == opcode && a.adr == adr &&
+              a.adr_relative == adr_relative;
+  idle_mode = same ? IdleMode::REPLAYING : IdleMode::NONE;
+  idle_next = 0;
+}
 
-    uint16_t temp = static_cast<uint16_t>(val) +
-                    static_cast<uint16_t>(accumulator) + get_flag(FLAGS::C);
+uint16_t Cpu::replay_idle_step() {
+  const IdleStep &step = idle_steps[idle_next];
+  idle_next = idle_next + 1 == idle_count ? 0 : idle_next + 1;
 
-    set_flag(FLAGS::C, temp & 0xFF00);
-    set_flag(FLAGS::Z, (temp & 0x00FF) == 0);
-    set_flag(FLAGS::N, temp & 0x0080);
-    set_flag(
-        FLAGS::V,
-        (static_cast<uint16_t>(accumulator) ^ static_cast<uint16_t>(temp)) &
-            (static_cast<uint16_t>(temp) ^ static_cast<uint16_t>(val)) &
-            0x0080);
+  uint64_t total = total_cycles;
+  uint8_t count = clock_count;
+  static_cast<CpuState &>(*this) = step.after;
+  total_cycles = total + step.cycles;
+  clock_count = count + step.cycles;
+  return step.cycles;
+}
 
-    accumulator = temp & 0x00FF;
+namespace {
+using a = Cpu;
 
-    return 0;
-  }
-  case Opcode::SBC_absY:
-    cycles = 4;
-    additional = absoluteY();
-    op_result = SBC();
-    break;
-  case Opcode::ASL_A: {
-    cycles = 2;
+// every opcode is the combination of an addressing mode and an operation,
+// so a handler is generated for each pair and the base cycle count is baked
+// in. The compiler inlines both member calls into the handler
+template <uint8_t (Cpu::*mode)(), uint8_t (Cpu::*op)(), uint8_t base_cycles>
+uint8_t run(Cpu &cpu) {
+  cpu.cycles = base_cycles;
+  uint8_t additional = (cpu.*mode)();
 
-    set_flag(FLAGS::C, accumulator >> 7);
-    accumulator = accumulator << 1;
+  // an extra cycle is only needed if both the operation and the addressing
+  // mode allow it (page crossed on a read)
+  return (cpu.*op)() & additional;
+}
 
-    update_accumulator_flags();
+// same as run, for a decoded instruction whose operand was already read and
+// whose base cycles were already set
+template <uint8_t (Cpu::*mode)(), uint8_t (Cpu::*op)()>
+uint8_t run_decoded(Cpu &cpu, uint16_t operand) {
+  uint8_t additional = cpu.decoded_mode<mode>(operand);
+  return (cpu.*op)() & additional;
+}
 
+template <uint8_t (Cpu::*mode)()> constexpr uint8_t operand_size() {
+  if constexpr (mode == &Cpu::imp)
     return 0;
-  }
-  case Opcode::ROL_A: {
-    cycles = 2;
-
-    uint8_t temp = get_flag(FLAGS::C);
-    set_flag(FLAGS::C, accumulator >> 7);
-    accumulator = accumulator << 1;
+  else if constexpr (mode == &Cpu::absolute || mode == &Cpu::absoluteX ||
+                     mode == &Cpu::absoluteY || mode == &Cpu::indirect)
+    return 2;
+  else
+    return 1;
+}
 
-    if (temp)
-      accumulator |= 0x01;
+template <uint8_t (Cpu::*mode)(), uint8_t (Cpu::*op)(), uint8_t base_cycles>
+constexpr Cpu::OpcodeInfo entry{run<mode, op, base_cycles>,
+                                run_decoded<mode, op>, base_cycles,
+                                1 + operand_size<mode>()};
+} // namespace
+
+// the addressing modes without reading the operand, which is already known.
+// The pointers of indirect, ind_X and ind_Y are still read since they can be
+// in RAM
+template <uint8_t (Cpu::*mode)()>
+uint8_t Cpu::decoded_mode(uint16_t operand) {
+  uint8_t low = operand & 0x00FF;
+  uint8_t high = operand >> 8;
+  if constexpr (mode == &Cpu::imp || mode == &Cpu::imm) {
+    return (this->*mode)();
+  } else if constexpr (mode == &Cpu::zpg) {
+    PC++;
+    adr = low;
+    return 0;
+  } else if constexpr (mode == &Cpu::zpgX || mode == &Cpu::zpgY) {
+    PC++;
+    adr = wrap_around(low, mode == &Cpu::zpgX ? x : y);
+    return 0;
+  } else if constexpr (mode == &Cpu::relative) {
+    PC++;
+    adr_relative = low;
+    if (0x80 & adr_relative)
+      adr_relative |= 0xFF00;
+    return 0;
+  } else if constexpr (mode == &Cpu::absolute) {
+    PC += 2;
+    adr = operand;
+    return 0;
+  } else if constexpr (mode == &Cpu::absoluteX || mode == &Cpu::absoluteY) {
+    PC += 2;
+    adr = operand + (mode == &Cpu::absoluteX ? x : y);
+    return (adr & 0xFF00) != (high << 8);
+  } else if constexpr (mode == &Cpu::indirect) {
+    PC += 2;
+    // this simulates a bug that was found in the NES hardware
+    if (low == 0x00FF)
+      adr = (read(operand & 0xFF00) << 8) | read(operand);
     else
-      accumulator &= 0xFE;
-
-    update_accumulator_flags();
-
+      adr = (read(operand + 1) << 8) | read(operand);
     return 0;
-  }
-  case Opcode::LSR_A: {
-    cycles = 2;
-
-    set_flag(FLAGS::C, accumulator & 0x01);
-    accumulator = accumulator >> 1;
-
-    set_flag(FLAGS::Z, accumulator == 0x00);
-    set_flag(FLAGS::N, accumulator & 0x80);
+  } else if constexpr (mode == &Cpu::ind_X) {
+    PC++;
+    uint8_t lo = read(wrap_around(low, x));
+    uint8_t hi = read(wrap_around(low + 1, x));
+    adr = (hi << 8) | lo;
     return 0;
+  } else {
+    static_assert(mode == &Cpu::ind_Y);
+    PC++;
+    uint16_t lo = read(low);
+    uint16_t hi = read(wrap_around(low, 1));
+    adr = ((hi << 8) | lo) + y;
+    return (adr & 0xFF00) != (hi << 8);
   }
-  case Opcode::ROR_A: {
-    cycles = 2;
-
-    uint8_t temp = get_flag(FLAGS::C);
-    set_flag(FLAGS::C,
-             accumulator & 0x01); // compiler gives warning, but code is correct
-    accumulator = accumulator >> 1;
-    if (temp)
-      accumulator |= 0x80;
-    else
-      accumulator &= 0x7F;
+}
 
-    set_flag(FLAGS::Z, accumulator == 0);
-    set_flag(FLAGS::N, temp);
+// indexed by opcode, same layout as the disassembler lookup table
+const std::array<Cpu::OpcodeInfo, 256> Cpu::dispatch = {
+    entry<&a::imp, &a::BRK, 7>, entry<&a::ind_X, &a::ORA, 6>,
+    entry<&a::imp, &a::XXX, 2>, entry<&a::imp, &a::XXX, 2>,
+    entry<&a::imp, &a::XXX, 2>, entry<&a::zpg, &a::ORA, 3>,
+    entry<&a::zpg, &a::ASL, 5>, entry<&a::imp, &a::XXX, 2>,
+    entry<&a::imp, &a::PHP, 3>, entry<&a::imm, &a::ORA, 2>,
+    entry<&a::imp, &a::ASL_A, 2>, entry<&a::imp, &a::XXX, 2>,
+    entry<&a::imp, &a::XXX, 2>, entry<&a::absolute, &a::ORA, 4>,
+    entry<&a::absolute, &a::ASL, 6>, entry<&a::imp, &a::XXX, 2>,
+    entry<&a::relative, &a::BPL, 2>, entry<&a::ind_Y, &a::ORA, 5>,
+    entry<&a::imp, &a::XXX, 2>, entry<&a::imp, &a::XXX, 2>,
+    entry<&a::imp, &a::XXX, 2>, entry<&a::zpgX, &a::ORA, 4>,
+    entry<&a::zpgX, &a::ASL, 6>, entry<&a::imp, &a::XXX, 2>,
+    entry<&a::imp, &a::CLC, 2>, entry<&a::absoluteY, &a::ORA, 4>,
+    entry<&a::imp, &a::XXX, 2>, entry<&a::imp, &a::XXX, 2>,
+    entry<&a::imp, &a::XXX, 2>, entry<&a::absoluteX, &a::ORA, 4>,
+    entry<&a::absoluteX, &a::ASL, 7>, entry<&a::imp, &a::XXX, 2>,
+    entry<&a::absolute, &a::JSR, 6>, entry<&a::ind_X, &a::AND, 6>,
+    entry<&a::imp, &a::XXX, 2>, entry<&a::imp, &a::XXX, 2>,
+    entry<&a::zpg, &a::BIT, 3>, entry<&a::zpg, &a::AND, 3>,
+    entry<&a::zpg, &a::ROL, 5>, entry<&a::imp, &a::XXX, 2>,
+    entry<&a::imp, &a::PLP, 4>, entry<&a::imm, &a::AND, 2>,
+    entry<&a::imp, &a::ROL_A, 2>, entry<&a::imp, &a::XXX, 2>,
+    entry<&a::absolute, &a::BIT, 4>, entry<&a::absolute, &a::AND, 4>,
+    entry<&a::absolute, &a::ROL, 6>, entry<&a::imp, &a::XXX, 2>,
+    entry<&a::relative, &a::BMI, 2>, entry<&a::ind_Y, &a::AND, 5>,
+    entry<&a::imp, &a::XXX, 2>, entry<&a::imp, &a::XXX, 2>,
+    entry<&a::imp, &a::XXX, 2>, entry<&a::zpgX, &a::AND, 4>,
+    entry<&a::zpgX, &a::ROL, 6>, entry<&a::imp, &a::XXX, 2>,
+    entry<&a::imp, &a::SEC, 2>, entry<&a::absoluteY, &a::AND, 4>,
+    entry<&a::imp, &a::XXX, 2>, entry<&a::imp, &a::XXX, 2>,
+    entry<&a::imp, &a::XXX, 2>, entry<&a::absoluteX, &a::AND, 4>,
+    entry<&a::absoluteX, &a::ROL, 7>, entry<&a::imp, &a::XXX, 2>,
+    entry<&a::imp, &a::RTI, 6>, entry<&a::ind_X, &a::EOR, 6>,
+    entry<&a::imp, &a::XXX, 2>, entry<&a::imp, &a::XXX, 2>,
+    entry<&a::imp, &a::XXX, 2>, entry<&a::zpg, &a::EOR, 3>,
+    entry<&a::zpg, &a::LSR, 5>, entry<&a::imp, &a::XXX, 2>,
+    entry<&a::imp, &a::PHA, 3>, entry<&a::imm, &a::EOR, 2>,
+    entry<&a::imp, &a::LSR_A, 2>, entry<&a::imp, &a::XXX, 2>,
+    entry<&a::absolute, &a::JMP, 3>, entry<&a::absolute, &a::EOR, 4>,
+    entry<&a::absolute, &a::LSR, 6>, entry<&a::imp, &a::XXX, 2>,
+    entry<&a::relative, &a::BVC, 2>, entry<&a::ind_Y, &a::EOR, 5>,
+    entry<&a::imp, &a::XXX, 2>, entry<&a::imp, &a::XXX, 2>,
+    entry<&a::imp, &a::XXX, 2>, entry<&a::zpgX, &a::EOR, 4>,
+    entry<&a::zpgX, &a::LSR, 6>, entry<&a::imp, &a::XXX, 2>,
+    entry<&a::imp, &a::CLI, 2>, entry<&a::absoluteY, &a::EOR, 4>,
+    entry<&a::imp, &a::XXX, 2>, entry<&a::imp, &a::XXX, 2>,
+    entry<&a::imp, &a::XXX, 2>, entry<&a::absoluteX, &a::EOR, 4>,
+    entry<&a::absoluteX, &a::LSR, 7>, entry<&a::imp, &a::XXX, 2>,
+    entry<&a::imp, &a::RTS, 6>, entry<&a::ind_X, &a::ADC, 6>,
+    entry<&a::imp, &a::XXX, 2>, entry<&a::imp, &a::XXX, 2>,
+    entry<&a::imp, &a::XXX, 2>, entry<&a::zpg, &a::ADC, 3>,
+    entry<&a::zpg, &a::ROR, 5>, entry<&a::imp, &a::XXX, 2>,
+    entry<&a::imp, &a::PLA, 4>, entry<&a::imm, &a::ADC, 2>,
+    entry<&a::imp, &a::ROR_A, 2>, entry<&a::imp, &a::XXX, 2>,
+    entry<&a::indirect, &a::JMP, 5>, entry<&a::absolute, &a::ADC, 4>,
+    entry<&a::absolute, &a::ROR, 6>, entry<&a::imp, &a::XXX, 2>,
+    entry<&a::relative, &a::BVS, 2>, entry<&a::ind_Y, &a::ADC, 5>,
+    entry<&a::imp, &a::XXX, 2>, entry<&a::imp, &a::XXX, 2>,
+    entry<&a::imp, &a::XXX, 2>, entry<&a::zpgX, &a::ADC, 4>,
+    entry<&a::zpgX, &a::ROR, 6>, entry<&a::imp, &a::XXX, 2>,
+    entry<&a::imp, &a::SEI, 2>, entry<&a::absoluteY, &a::ADC, 4>,
+    entry<&a::imp, &a::XXX, 2>, entry<&a::imp, &a::XXX, 2>,
+    entry<&a::imp, &a::XXX, 2>, entry<&a::absoluteX, &a::ADC, 4>,
+    entry<&a::absoluteX, &a::ROR, 7>, entry<&a::imp, &a::XXX, 2>,
+    entry<&a::imp, &a::XXX, 2>, entry<&a::ind_X, &a::STA, 6>,
+    entry<&a::imp, &a::XXX, 2>, entry<&a::imp, &a::XXX, 2>,
+    entry<&a::zpg, &a::STY, 3>, entry<&a::zpg, &a::STA, 3>,
+    entry<&a::zpg, &a::STX, 3>, entry<&a::imp, &a::XXX, 2>,
+    entry<&a::imp, &a::DEY, 2>, entry<&a::imp, &a::XXX, 2>,
+    entry<&a::imp, &a::TXA, 2>, entry<&a::imp, &a::XXX, 2>,
+    entry<&a::absolute, &a::STY, 4>, entry<&a::absolute, &a::STA, 4>,
+    entry<&a::absolute, &a::STX, 4>, entry<&a::imp, &a::XXX, 2>,
+    entry<&a::relative, &a::BCC, 2>, entry<&a::ind_Y, &a::STA, 6>,
+    entry<&a::imp, &a::XXX, 2>, entry<&a::imp, &a::XXX, 2>,
+    entry<&a::zpgX, &a::STY, 4>, entry<&a::zpgX, &a::STA, 4>,
+    entry<&a::zpgY, &a::STX, 4>, entry<&a::imp, &a::XXX, 2>,
+    entry<&a::imp, &a::TYA, 2>, entry<&a::absoluteY, &a::STA, 5>,
+    entry<&a::imp, &a::TXS, 2>, entry<&a::imp, &a::XXX, 2>,
+    entry<&a::imp, &a::XXX, 2>, entry<&a::absoluteX, &a::STA, 5>,
+    entry<&a::imp, &a::XXX, 2>, entry<&a::imp, &a::XXX, 2>,
+    entry<&a::imm, &a::LDY, 2>, entry<&a::ind_X, &a::LDA, 6>,
+    entry<&a::imm, &a::LDX, 2>, entry<&a::imp, &a::XXX, 2>,
+    entry<&a::zpg, &a::LDY, 3>, entry<&a::zpg, &a::LDA, 3>,
+    entry<&a::zpg, &a::LDX, 3>, entry<&a::imp, &a::XXX, 2>,
+    entry<&a::imp, &a::TAY, 2>, entry<&a::imm, &a::LDA, 2>,
+    entry<&a::imp, &a::TAX, 2>, entry<&a::imp, &a::XXX, 2>,
+    entry<&a::absolute, &a::LDY, 4>, entry<&a::absolute, &a::LDA, 4>,
+    entry<&a::absolute, &a::LDX, 4>, entry<&a::imp, &a::XXX, 2>,
+    entry<&a::relative, &a::BCS, 2>, entry<&a::ind_Y, &a::LDA, 5>,
+    entry<&a::imp, &a::XXX, 2>, entry<&a::imp, &a::XXX, 2>,
+    entry<&a::zpgX, &a::LDY, 4>, entry<&a::zpgX, &a::LDA, 4>,
+    entry<&a::zpgY, &a::LDX, 4>, entry<&a::imp, &a::XXX, 2>,
+    entry<&a::imp, &a::CLV, 2>, entry<&a::absoluteY, &a::LDA, 4>,
+    entry<&a::imp, &a::TSX, 2>, entry<&a::imp, &a::XXX, 2>,
+    entry<&a::absoluteX, &a::LDY, 4>, entry<&a::absoluteX, &a::LDA, 4>,
+    entry<&a::absoluteY, &a::LDX, 4>, entry<&a::imp, &a::XXX, 2>,
+    entry<&a::imm, &a::CPY, 2>, entry<&a::ind_X, &a::CMP, 6>,
+    entry<&a::imp, &a::XXX, 2>, entry<&a::imp, &a::XXX, 2>,
+    entry<&a::zpg, &a::CPY, 3>, entry<&a::zpg, &a::CMP, 3>,
+    entry<&a::zpg, &a::DEC, 5>, entry<&a::imp, &a::XXX, 2>,
+    entry<&a::imp, &a::INY, 2>, entry<&a::imm, &a::CMP, 2>,
+    entry<&a::imp, &a::DEX, 2>, entry<&a::imp, &a::XXX, 2>,
+    entry<&a::absolute, &a::CPY, 4>, entry<&a::absolute, &a::CMP, 4>,
+    entry<&a::absolute, &a::DEC, 6>, entry<&a::imp, &a::XXX, 2>,
+    entry<&a::relative, &a::BNE, 2>, entry<&a::ind_Y, &a::CMP, 5>,
+    entry<&a::imp, &a::XXX, 2>, entry<&a::imp, &a::XXX, 2>,
+    entry<&a::imp, &a::XXX, 2>, entry<&a::zpgX, &a::CMP, 4>,
+    entry<&a::zpgX, &a::DEC, 6>, entry<&a::imp, &a::XXX, 2>,
+    entry<&a::imp, &a::CLD, 2>, entry<&a::absoluteY, &a::CMP, 4>,
+    entry<&a::imp, &a::XXX, 2>, entry<&a::imp, &a::XXX, 2>,
+    entry<&a::imp, &a::XXX, 2>, entry<&a::absoluteX, &a::CMP, 4>,
+    entry<&a::absoluteX, &a::DEC, 7>, entry<&a::imp, &a::XXX, 2>,
+    entry<&a::imm, &a::CPX, 2>, entry<&a::ind_X, &a::SBC, 6>,
+    entry<&a::imp, &a::XXX, 2>, entry<&a::imp, &a::XXX, 2>,
+    entry<&a::zpg, &a::CPX, 3>, entry<&a::zpg, &a::SBC, 3>,
+    entry<&a::zpg, &a::INC, 5>, entry<&a::imp, &a::XXX, 2>,
+    entry<&a::imp, &a::INX, 2>, entry<&a::imm, &a::SBC, 2>,
+    entry<&a::imp, &a::NOP, 2>, entry<&a::imp, &a::XXX, 2>,
+    entry<&a::absolute, &a::CPX, 4>, entry<&a::absolute, &a::SBC, 4>,
+    entry<&a::absolute, &a::INC, 6>, entry<&a::imp, &a::XXX, 2>,
+    entry<&a::relative, &a::BEQ, 2>, entry<&a::ind_Y, &a::SBC, 5>,
+    entry<&a::imp, &a::XXX, 2>, entry<&a::imp, &a::XXX, 2>,
+    entry<&a::imp, &a::XXX, 2>, entry<&a::zpgX, &a::SBC, 4>,
+    entry<&a::zpgX, &a::INC, 6>, entry<&a::imp, &a::XXX, 2>,
+    entry<&a::imp, &a::SED, 2>, entry<&a::absoluteY, &a::SBC, 4>,
+    entry<&a::imp, &a::XXX, 2>, entry<&a::imp, &a::XXX, 2>,
+    entry<&a::imp, &a::XXX, 2>, entry<&a::absoluteX, &a::SBC, 4>,
+    entry<&a::absoluteX, &a::INC, 7>, entry<&a::imp, &a::XXX, 2>,
+};
 
-    return 0;
-  }
-  case Opcode::TXA_impl:
-    cycles = 2;
-    accumulator = x;
-    update_accumulator_flags();
-    break;
-  case Opcode::TXS_impl:
-    cycles = 2;
-    stack_pointer = x;
-    break;
-  case Opcode::TAX_impl:
-    cycles = 2;
-    x = accumulator;
-    update_x_flags();
-    break;
-  case Opcode::TSX_impl:
-    cycles = 2;
-    x = stack_pointer;
-    update_x_flags();
-    break;
-  case Opcode::DEX_impl:
-    cycles = 2;
-    x -= 1;
+uint8_t Cpu::execute_opcode(Opcode opcode) {
+  return dispatch[static_cast<uint8_t>(opcode)].run(*this);
+}
 
-    update_x_flags();
-    return 0;
-  case Opcode::NOP_impl:
-    cycles = 2;
+void Cpu::connect_prg(std::span<const uint8_t> prg) {
+  prg_rom = prg;
+  decoded.assign(prg.size(), DecodedOp{});
+}
 
-    // TODO
-    break;
-  case Opcode::BIT_abs:
-    cycles = 4;
-    additional = absolute();
-    op_result = BIT();
-    break;
-  case Opcode::JMP_abs:
-    cycles = 3;
-    additional = absolute();
-    op_result = JMP();
-    break;
-  case Opcode::JMP_ind:
-    cycles = 5;
-    additional = indirect();
-    op_result = JMP();
-    break;
-  case Opcode::STY_abs:
-    cycles = 4;
-    additional = absolute();
-    op_result = STY();
-    break;
-  case Opcode::LDY_abs:
-    cycles = 4;
-    additional = absolute();
-    op_result = LDY();
-    break;
-  case Opcode::LDY_absX:
-    cycles = 4;
-    additional = absoluteX();
-    op_result = LDY();
-    break;
-  case Opcode::CP_absY:
-    cycles = 4;
-    additional = absolute();
-    op_result = CPY();
-    break;
-  case Opcode::CP_absX:
-    cycles = 4;
-    additional = absolute();
-    op_result = CPX();
-    break;
-  case Opcode::ORA_abs:
-    cycles = 4;
-    additional = absolute();
-    op_result = ORA();
-    break;
-  case Opcode::ORA_absX:
-    cycles = 4;
-    additional = absoluteX();
-    op_result = ORA();
-    break;
-  case Opcode::AND_abs:
-    cycles = 4;
-    additional = absolute();
-    op_result = AND();
-    break;
-  case Opcode::AND_absX:
-    cycles = 4;
-    additional = absoluteX();
-    op_result = AND();
-    break;
-  case Opcode::EOR_abs:
-    cycles = 4;
-    additional = absolute();
-    op_result = EOR();
-    break;
-  case Opcode::EOR_absX:
-    cycles = 4;
-    additional = absoluteX();
-    op_result = EOR();
-    break;
-  case Opcode::ADC_abs:
-    cycles = 4;
-    additional = absolute();
-    op_result = ADC();
-    break;
-  case Opcode::ADC_absX:
-    cycles = 4;
-    additional = absoluteX();
-    op_result = ADC();
-    break;
-  case Opcode::STA_abs:
-    cycles = 4;
-    additional = absolute();
-    op_result = STA();
-    break;
-  case Opcode::STA_absX:
-    cycles = 5;
-    additional = absoluteX();
-    op_result = STA();
-    break;
-  case Opcode::LDA_abs:
-    cycles = 4;
-    additional = absolute();
-    op_result = LDA();
-    break;
-  case Opcode::LDA_absX:
-    cycles = 4;
-    additional = absoluteX();
-    op_result = LDA();
-    break;
-  case Opcode::CMP_abs:
-    cycles = 4;
-    additional = absolute();
-    op_result = CMP();
-    break;
-  case Opcode::CMP_absX:
-    cycles = 4;
-    additional = absoluteX();
-    op_result = CMP();
-    break;
-  case Opcode::SBC_abs:
-    cycles = 4;
-    additional = absolute();
-    op_result = SBC();
-    break;
-  case Opcode::SBC_absX:
-    cycles = 4;
-    additional = absoluteX();
-    op_result = SBC();
-    break;
-  case Opcode::ASL_abs:
-    cycles = 6;
-    additional = absolute();
-    op_result = ASL();
-    break;
-  case Opcode::ASL_absX:
-    cycles = 7;
-    additional = absoluteX();
-    op_result = ASL();
-    break;
-  case Opcode::ROL_abs:
-    cycles = 6;
-    additional = absolute();
-    op_result = ROL();
-    break;
-  case Opcode::ROL_absX:
-    cycles = 7;
-    additional = absoluteX();
-    op_result = ROL();
-    break;
-  case Opcode::LSR_abs:
-    cycles = 6;
-    additional = absolute();
-    op_result = LSR();
-    break;
-  case Opcode::LSR_absX:
-    cycles = 7;
-    additional = absoluteX();
-    op_result = LSR();
-    break;
-  case Opcode::ROR_abs:
-    cycles = 6;
-    additional = absolute();
-    op_result = ROR();
-    break;
-  case Opcode::ROR_absX:
-    cycles = 7;
-    additional = absoluteX();
-    op_result = ROR();
-    break;
-  case Opcode::STX_abs:
-    cycles = 4;
-    additional = absolute();
-    op_result = STX();
-    break;
-  case Opcode::LDX_abs:
-    cycles = 4;
-    additional = absolute();
-    op_result = LDX();
-    break;
-  case Opcode::LDX_absY:
-    cycles = 4;
-    additional = absoluteY();
-    op_result = LDX();
-    break;
-  case Opcode::DEC_abs:
-    cycles = 6;
-    additional = absolute();
-    op_result = DEC();
-    break;
-  case Opcode::DEC_absX:
-    cycles = 7;
-    additional = absoluteX();
-    op_result = DEC();
-    break;
-  case Opcode::INC_abs:
-    cycles = 6;
-    additional = absolute();
-    op_result = INC();
-    break;
-  case Opcode::INC_absX:
-    cycles = 7;
-    additional = absoluteX();
-    op_result = INC();
-    break;
+uint8_t Cpu::run_from_cache(const uint8_t *code) {
+  DecodedOp &op = decoded[code - prg_rom.data()];
+  if (!op.run) {
+    const OpcodeInfo &info = dispatch[*code];
+    // the operand has to be in the same bank, the next page may be mapped
+    // anywhere
+    uint16_t last = PC + info.length - 1;
+    if (bus->memory_at(last) != code + info.length - 1) {
+      opcode = *code;
+      PC++;
+      return execute_opcode(static_cast<Opcode>(opcode));
+    }
+
+    uint16_t operand = 0;
+    if (info.length > 1)
+      operand = code[1];
+    if (info.length > 2)
+      operand |= code[2] << 8;
+    op = DecodedOp{info.run_decoded, operand, info.cycles, info.length};
   }
 
-  return op_result & additional;
+  opcode = *code;
+  PC++;
+  cycles = op.cycles;
+  return op.run(*this, op.operand);
 }
 
 void Cpu::irq() {
@@ -1249,7 +648,7 @@ void Cpu::irq() {
   set_flag(FLAGS::I, 1);
   set_flag(FLAGS::B, 0);
   set_flag(FLAGS::U, 1);
-  push(status);
+  push(get_status());
 
   uint8_t low = read(0xFFFE);
   uint8_t high = read(0xFFFF);
@@ -1271,7 +670,7 @@ void Cpu::nmi() {
   set_flag(FLAGS::U, 1);
   set_flag(FLAGS::I, 1);
 
-  push(status);
+  push(get_status());
 
   uint8_t low = read(0xFFFA);
   uint8_t high = read(0xFFFA + 1);
@@ -1282,12 +681,13 @@ void Cpu::nmi() {
 }
 
 void Cpu::reset() {
+  idle_mode = IdleMode::NONE;
   stack_pointer = 0xFF; // might change
   accumulator = 0x00;
   x = 0x00;
   y = 0x00;
 
-  status = 0x00 | FLAGS::U;
+  set_status(0x00 | FLAGS::U);
   // reset vector is hard coded at FFFC
   adr = 0xFFFC;
   uint8_t low = read(adr);
@@ -1295,7 +695,7 @@ void Cpu::reset() {
 
   PC = convertTo_16_bit(high, low);
 
-  status = 0x24;
+  set_status(0x24);
   fetched = 0x00;
   adr = 0x0000;
   adr_relative = 0x00;
@@ -1327,6 +727,12 @@ uint16_t convertTo_16_bit(uint8_t high, uint8_t low) {
   return (high << 8) | low;
 }
 
+uint8_t Cpu::imm() {
+  adr = PC++;
+
+  return 0;
+}
+
 uint8_t Cpu::zpg() {
   adr = read(PC++);
   adr &= 0x00FF;
@@ -1446,8 +852,8 @@ uint8_t Cpu::AND() {
   return 1;
 }
 
-uint8_t Cpu::BCS() {
-  if (get_flag(FLAGS::C)) {
+uint8_t Cpu::branch(bool taken) {
+  if (taken) {
     cycles++;
 
     adr = PC + adr_relative;
@@ -1462,6 +868,22 @@ uint8_t Cpu::BCS() {
   return 0;
 }
 
+uint8_t Cpu::BPL() { return branch(get_flag(FLAGS::N) == 0); }
+
+uint8_t Cpu::BMI() { return branch(get_flag(FLAGS::N)); }
+
+uint8_t Cpu::BVC() { return branch(get_flag(FLAGS::V) == 0); }
+
+uint8_t Cpu::BVS() { return branch(get_flag(FLAGS::V)); }
+
+uint8_t Cpu::BCC() { return branch(!get_flag(FLAGS::C)); }
+
+uint8_t Cpu::BCS() { return branch(get_flag(FLAGS::C)); }
+
+uint8_t Cpu::BNE() { return branch(!get_flag(FLAGS::Z)); }
+
+uint8_t Cpu::BEQ() { return branch(get_flag(FLAGS::Z)); }
+
 uint8_t Cpu::LDY() {
   uint8_t val = fetch();
 
@@ -1483,11 +905,10 @@ uint8_t Cpu::LDX() {
 uint8_t Cpu::BIT() {
   fetch();
 
-  uint8_t temp = accumulator & fetched;
-
-  set_flag(FLAGS::Z, temp == 0x00);
-  set_flag(FLAGS::N, fetched >> 7);
-  set_flag(FLAGS::V, fetched & 0x40);
+  // Z comes from the AND, but N and V are bits 7 and 6 of memory
+  z_result = accumulator & fetched;
+  n_result = fetched;
+  overflow = fetched & 0x40;
 
   return 0;
 }
@@ -1496,9 +917,8 @@ uint8_t Cpu::CPX() {
   uint8_t val = fetch();
   uint16_t temp = (uint16_t)x - (uint16_t)fetched;
 
-  set_flag(FLAGS::Z, (temp & 0x00FF) == 0x0000);
-  set_flag(FLAGS::C, x >= val);
-  set_flag(FLAGS::N, temp & 0x0080);
+  carry = x >= val;
+  set_nz(temp & 0x00FF);
 
   return 0;
 }
@@ -1506,9 +926,8 @@ uint8_t Cpu::CPX() {
 uint8_t Cpu::CMP() {
   fetch();
   uint16_t temp = (uint16_t)accumulator - (uint16_t)fetched;
-  set_flag(C, accumulator >= fetched);
-  set_flag(Z, (temp & 0x00FF) == 0x0000);
-  set_flag(N, temp & 0x0080);
+  carry = accumulator >= fetched;
+  set_nz(temp & 0x00FF);
   return 1;
 }
 
@@ -1516,9 +935,8 @@ uint8_t Cpu::CPY() {
   uint8_t val = fetch();
   uint16_t temp = (uint16_t)y - (uint16_t)fetched;
 
-  set_flag(FLAGS::Z, (temp & 0x00FF) == 0x0000);
-  set_flag(FLAGS::C, y >= val);
-  set_flag(FLAGS::N, temp & 0x0080);
+  carry = y >= val;
+  set_nz(temp & 0x00FF);
 
   return 0;
 }
@@ -1539,14 +957,12 @@ uint8_t Cpu::ADC() {
   uint16_t temp = static_cast<uint16_t>(val) +
                   static_cast<uint16_t>(accumulator) + get_flag(FLAGS::C);
 
-  set_flag(FLAGS::C, temp > 255);
-  set_flag(FLAGS::Z, (temp & 0x00FF) == 0);
-  set_flag(FLAGS::N, temp & 0x80);
-  set_flag(
-      FLAGS::V,
+  carry = temp > 255;
+  set_nz(temp & 0x00FF);
+  overflow =
       (~(static_cast<uint16_t>(accumulator) ^ static_cast<uint16_t>(val)) &
        (static_cast<uint16_t>(accumulator) ^ static_cast<uint16_t>(temp))) &
-          0x0080);
+      0x0080;
 
   accumulator = temp & 0x00FF;
 
@@ -1561,13 +977,11 @@ uint8_t Cpu::SBC() {
   uint16_t temp = static_cast<uint16_t>(val) +
                   static_cast<uint16_t>(accumulator) + get_flag(FLAGS::C);
 
-  set_flag(FLAGS::C, temp > 255);
-  set_flag(FLAGS::Z, (temp & 0x00FF) == 0);
-  set_flag(FLAGS::N, temp & 0x80);
-  set_flag(FLAGS::V,
-           (static_cast<uint16_t>(accumulator) ^ static_cast<uint16_t>(temp)) &
-               (static_cast<uint16_t>(val) ^ static_cast<uint16_t>(temp)) &
-               0x0080);
+  carry = temp > 255;
+  set_nz(temp & 0x00FF);
+  overflow =
+      (static_cast<uint16_t>(accumulator) ^ static_cast<uint16_t>(temp)) &
+      (static_cast<uint16_t>(val) ^ static_cast<uint16_t>(temp)) & 0x0080;
 
   accumulator = temp & 0x00FF;
 
@@ -1603,21 +1017,16 @@ uint8_t Cpu::STX() {
 uint8_t Cpu::ASL() {
   fetch();
 
-  set_flag(FLAGS::C, fetched >> 7);
+  carry = fetched >> 7;
   write(adr, fetched << 1);
 
-  fetch();
-  set_flag(FLAGS::N, fetched >> 7);
-  set_flag(FLAGS::Z, fetched == 0x00);
+  set_nz(fetch());
   return 0;
 }
 
 uint8_t Cpu::DEC() {
   write(adr, fetch() - 1);
-  fetch();
-
-  set_flag(FLAGS::Z, fetched == 0);
-  set_flag(FLAGS::N, fetched >> 7);
+  set_nz(fetch());
   return 0;
 }
 
@@ -1627,10 +1036,7 @@ uint8_t Cpu::INC() {
   write(adr, value & 0x00FF); // Write the incremented value back to memory
 
   // Update flags based on the incremented value
-  set_flag(FLAGS::Z,
-           (value & 0x00FF) == 0); // Zero flag is set if the result is 0
-  set_flag(FLAGS::N,
-           value & 0x0080); // Negative flag is set based on the new bit 7
+  set_nz(value & 0x00FF);
 
   return 0;
 }
@@ -1639,7 +1045,7 @@ uint8_t Cpu::ROL() {
   fetch();
 
   uint8_t temp = get_flag(FLAGS::C);
-  set_flag(FLAGS::C, fetched >> 7);
+  carry = fetched >> 7;
   fetched = fetched << 1;
 
   if (temp)
@@ -1648,17 +1054,15 @@ uint8_t Cpu::ROL() {
     fetched &= 0xFE;
 
   write(adr, fetched);
-  set_flag(FLAGS::N, fetched >> 7);
-  set_flag(FLAGS::Z, fetched == 0x00);
+  set_nz(fetched);
   return 0;
 }
 
 uint8_t Cpu::ROR() {
   fetch();
   uint16_t temp = (uint16_t)(get_flag(C) << 7) | (fetched >> 1);
-  set_flag(C, fetched & 0x01);
-  set_flag(Z, (temp & 0x00FF) == 0x00);
-  set_flag(N, temp & 0x0080);
+  carry = fetched & 0x01;
+  set_nz(temp & 0x00FF);
   write(adr, temp & 0x00FF);
 
   return 0;
@@ -1666,10 +1070,9 @@ uint8_t Cpu::ROR() {
 
 uint8_t Cpu::LSR() {
   fetch();
-  set_flag(C, fetched & 0x01);
+  carry = fetched & 0x01;
   uint16_t temp = fetched >> 1;
-  set_flag(Z, (temp & 0x00FF) == 0x0000);
-  set_flag(N, temp & 0x0080);
+  set_nz(temp & 0x00FF);
   write(adr, temp & 0x00FF);
   return 0;
 }
@@ -1689,21 +1092,219 @@ uint8_t Cpu::LDA() {
   return 1;
 }
 
-void Cpu::update_accumulator_flags() {
-  set_flag(FLAGS::Z, accumulator == 0x00);
-  set_flag(FLAGS::N, (accumulator >> 7) == 1);
+uint8_t Cpu::BRK() {
+  PC++;
+
+  push(get_high(PC));
+  push(get_low(PC));
+
+  set_flag(FLAGS::I, 1);
+  set_flag(FLAGS::B, 1);
+  push(get_status());
+  set_flag(FLAGS::B, 0);
+
+  PC = convertTo_16_bit(read(0xFFFF), read(0xFFFE));
+  return 0;
+}
+
+uint8_t Cpu::JSR() {
+  PC--;
+  push(get_high(PC));
+  push(get_low(PC));
+  fetch();
+  PC = adr;
+  return 0;
+}
+
+uint8_t Cpu::RTI() {
+  set_status(pull() & ~FLAGS::B & ~FLAGS::U);
+
+  uint8_t low = pull();
+  uint8_t high = pull();
+
+  PC = convertTo_16_bit(high, low);
+  return 0;
+}
+
+uint8_t Cpu::RTS() {
+  uint8_t low = pull();
+  uint8_t high = pull();
+
+  PC = convertTo_16_bit(high, low) + 1;
+  return 0;
+}
+
+uint8_t Cpu::PHP() {
+  push(get_status() | 0x30);
+  return 0;
+}
+
+uint8_t Cpu::PLP() {
+  uint8_t new_status = pull();
+  set_status(new_status & (0b11001111));
+  return 0;
+}
+
+uint8_t Cpu::PHA() {
+  push(accumulator);
+  return 0;
+}
+
+uint8_t Cpu::PLA() {
+  accumulator = pull();
+  update_accumulator_flags();
+  return 0;
+}
+
+uint8_t Cpu::CLC() {
+  set_flag(FLAGS::C, 0);
+  return 0;
+}
+
+uint8_t Cpu::SEC() {
+  set_flag(FLAGS::C, 1);
+  return 0;
+}
+
+uint8_t Cpu::CLI() {
+  set_flag(FLAGS::I, 0);
+  return 0;
+}
+
+uint8_t Cpu::SEI() {
+  set_flag(FLAGS::I, 1);
+  return 0;
+}
+
+uint8_t Cpu::CLV() {
+  set_flag(FLAGS::V, 0);
+  return 0;
+}
+
+uint8_t Cpu::CLD() {
+  set_flag(FLAGS::D, 0);
+  return 0;
+}
+
+uint8_t Cpu::SED() {
+  set_flag(FLAGS::D, 1);
+  return 0;
+}
+
+uint8_t Cpu::DEY() {
+  y -= 1;
+  update_y_flags();
+  return 0;
+}
+
+uint8_t Cpu::INY() {
+  y += 1;
+  update_y_flags();
+  return 0;
+}
+
+uint8_t Cpu::DEX() {
+  x -= 1;
+  update_x_flags();
+  return 0;
+}
+
+uint8_t Cpu::INX() {
+  x += 1;
+  update_x_flags();
+  return 0;
+}
+
+uint8_t Cpu::TYA() {
+  accumulator = y;
+  update_accumulator_flags();
+  return 0;
+}
+
+uint8_t Cpu::TAY() {
+  y = accumulator;
+  update_y_flags();
+  return 0;
+}
+
+uint8_t Cpu::TXA() {
+  accumulator = x;
+  update_accumulator_flags();
+  return 0;
+}
+
+uint8_t Cpu::TAX() {
+  x = accumulator;
+  update_x_flags();
+  return 0;
+}
+
+uint8_t Cpu::TXS() {
+  stack_pointer = x;
+  return 0;
+}
+
+uint8_t Cpu::TSX() {
+  x = stack_pointer;
+  update_x_flags();
+  return 0;
+}
+
+uint8_t Cpu::NOP() { return 0; }
+
+// unofficial opcodes are not emulated, they only take up the cycles of a NOP
+uint8_t Cpu::XXX() { return 0; }
+
+uint8_t Cpu::ASL_A() {
+  carry = accumulator >> 7;
+  accumulator = accumulator << 1;
+
+  update_accumulator_flags();
+  return 0;
+}
+
+uint8_t Cpu::ROL_A() {
+  uint8_t temp = get_flag(FLAGS::C);
+  carry = accumulator >> 7;
+  accumulator = accumulator << 1;
+
+  if (temp)
+    accumulator |= 0x01;
+  else
+    accumulator &= 0xFE;
+
+  update_accumulator_flags();
+  return 0;
 }
 
-void Cpu::update_y_flags() {
-  set_flag(FLAGS::Z, y == 0x00);
-  set_flag(FLAGS::N, (y >> 7) == 1);
+uint8_t Cpu::LSR_A() {
+  carry = accumulator & 0x01;
+  accumulator = accumulator >> 1;
+
+  update_accumulator_flags();
+  return 0;
 }
 
-void Cpu::update_x_flags() {
-  set_flag(FLAGS::Z, x == 0x00);
-  set_flag(FLAGS::N, (x >> 7) == 1);
+uint8_t Cpu::ROR_A() {
+  uint8_t temp = get_flag(FLAGS::C);
+  carry = accumulator & 0x01;
+  accumulator = accumulator >> 1;
+  if (temp)
+    accumulator |= 0x80;
+  else
+    accumulator &= 0x7F;
+
+  // N is the old carry, which is now bit 7
+  update_accumulator_flags();
+  return 0;
 }
 
+void Cpu::update_accumulator_flags() { set_nz(accumulator); }
+
+void Cpu::update_y_flags() { set_nz(y); }
+
+void Cpu::update_x_flags() { set_nz(x); }
+
 uint8_t wrap_around(uint16_t val1, uint16_t val2) {
   return (val1 + val2) & 0x00FF;
 }
@@ -1,11 +1,13 @@
 #ifndef CPU_H
 #define CPU_H
 
-#include <fstream>
+#include <array>
 #include <string>
 #include <cstdint>
 #include <vector>
 #include <map>
+#include <span>
+#include <stdexcept>
 
 // all opcodes (possible ways of optimization in future)
 enum class Opcode: uint8_t {
@@ -175,9 +177,13 @@ enum FLAGS {
 
 class Bus;  // forward declaration for Bus
 
-// CPU is owned by Bus
-struct Cpu {
+// longest idle loop that is looked for, in instructions and in bytes
+#define IDLE_LOOP_STEPS 8
+#define IDLE_LOOP_BYTES 16
 
+// registers and everything else the CPU needs to carry on from where it is,
+// kept apart from the rest so a save state can copy it in one go
+struct CpuState {
     uint8_t accumulator{0x00};
     uint8_t x{0x00}; // y register
     uint8_t y{0x00}; // x register
@@ -185,18 +191,27 @@ struct Cpu {
     // check that it starts right
     uint8_t stack_pointer{0xFD}; // top of stack. Stack spans addresses: 0x0100 to 0x01FF
     uint16_t PC{0x0000}; // program counter
-    uint8_t status{0x00}; // flags state
+    // flags state, N Z C and V are only worked out when they are needed
+    // since most instructions overwrite them. get_status() gives all of them
+    uint8_t status_idbu{0x00}; // I, D, B and U, the other bits are unused
+    uint8_t n_result{0x00}; // N is bit 7 of this
+    uint8_t z_result{0x01}; // Z is set when this is 0
+    bool carry{false};
+    bool overflow{false};
     uint8_t fetched{0x00};
-    uint8_t cycles{0x00};
-    int total_cycles{0};
+    // wide enough for the 513 cycles of an OAM DMA
+    uint16_t cycles{0x0000};
+    uint64_t total_cycles{0};
     uint8_t opcode{0x00};
     uint16_t adr{0x0000};
     uint16_t adr_relative{0x0000};
 
     uint8_t clock_count{0x00};
     bool oam{false};
+};
 
-    std::ofstream log{"debug.txt"};
+// CPU is owned by Bus
+struct Cpu : CpuState {
 
     // Pointer to Bus it's a part of
     Bus *bus{nullptr};
@@ -209,11 +224,76 @@ struct Cpu {
     std::map<uint16_t, std::string> disassemble(uint16_t nStart, uint16_t nStop);
 
     // get the status of the wanted flag
-    uint8_t get_flag(FLAGS flag) const;
+    uint8_t get_flag(FLAGS flag) const {
+      switch (flag) {
+      case FLAGS::C:
+        return carry ? FLAGS::C : 0;
+      case FLAGS::Z:
+        return z_result == 0 ? FLAGS::Z : 0;
+      case FLAGS::V:
+        return overflow ? FLAGS::V : 0;
+      case FLAGS::N:
+        return n_result & FLAGS::N;
+      case FLAGS::I:
+      case FLAGS::D:
+      case FLAGS::B:
+      case FLAGS::U:
+        return status_idbu & flag;
+      default:
+        throw std::runtime_error("Invalid flag");
+      }
+    }
 
     // toggle flag on or off
     void set_flag(FLAGS flag, bool on);
+
+    // the status register as the 6502 has it
+    uint8_t get_status() const;
+    void set_status(uint8_t status);
+    // sets N and Z from the result of an instruction
+    void set_nz(uint8_t result) {
+      n_result = result;
+      z_result = result;
+    }
     void clock();
+    // runs the whole next instruction (or what is left of an interrupt) at
+    // once and returns the number of cycles it took
+    uint16_t step();
+    // fetches and executes the next instruction, or starts the OAM DMA stall,
+    // and adds its cycles to the cycle count
+    void start_instruction();
+
+    // idle loops. A short loop that only reads memory and branches, and
+    // gets back to its start with the registers it started with, does the
+    // same thing over and over until an interrupt or a write changes
+    // something. Once a loop was seen doing that, step replays the state
+    // after each of its instructions instead of running them
+    struct IdleStep {
+      uint16_t pc; // where the instruction is
+      uint16_t cycles;
+      CpuState after; // the cycle counts in it are not used
+    };
+    enum class IdleMode : uint8_t { NONE, RECORDING, REPLAYING };
+    IdleMode idle_mode{IdleMode::NONE};
+    IdleStep idle_steps[IDLE_LOOP_STEPS];
+    uint8_t idle_count{0};
+    uint8_t idle_next{0};
+    // first and last instruction of the loop, and the state at its start
+    uint16_t idle_start{0};
+    uint16_t idle_end{0};
+    CpuState idle_head;
+    // start and end of the last loop that turned out not to be an idle one
+    uint32_t idle_rejected{0};
+
+    // needs to be called when the memory was changed from outside the CPU
+    void forget_idle_loop() { idle_mode = IdleMode::NONE; }
+    // pc jumped back to PC, starts recording if it is an idle loop
+    void find_idle_loop(uint16_t pc);
+    void record_idle_step(uint16_t pc);
+    uint16_t replay_idle_step();
+    // bytes of an instruction that can be part of an idle loop, 0 if it
+    // can't be
+    uint8_t idle_instruction(uint16_t pc) const;
 
     // sets everything back to default parameters
     void reset();
@@ -226,6 +306,37 @@ struct Cpu {
     // function to verify which instruction to execute
     uint8_t execute_opcode(Opcode opcode);
 
+    // one handler per opcode, each one runs the addressing mode and the
+    // operation of the instruction and returns the additional cycle
+    using Handler = uint8_t (*)(Cpu &);
+    // the same handler for an instruction that was already decoded, it
+    // doesn't read the operand or set the base cycles
+    using DecodedHandler = uint8_t (*)(Cpu &, uint16_t operand);
+    struct OpcodeInfo {
+      Handler run;
+      DecodedHandler run_decoded;
+      uint8_t cycles; // base cycles
+      uint8_t length; // in bytes, with the opcode
+    };
+    static const std::array<OpcodeInfo, 256> dispatch;
+    template <uint8_t (Cpu::*mode)()> uint8_t decoded_mode(uint16_t operand);
+
+    // the instructions of the PRG ROM decoded once, indexed by their offset
+    // in the ROM rather than by their address so switching banks doesn't
+    // invalidate them. run is nullptr until the instruction is decoded
+    struct DecodedOp {
+      DecodedHandler run{nullptr};
+      uint16_t operand{0};
+      uint8_t cycles{0};
+      uint8_t length{0};
+    };
+    std::span<const uint8_t> prg_rom;
+    std::vector<DecodedOp> decoded;
+    // needs to be called when a cartridge is inserted
+    void connect_prg(std::span<const uint8_t> prg);
+    // runs the instruction at PC, which is at code in the PRG ROM
+    uint8_t run_from_cache(const uint8_t *code);
+
     bool complete() const;
 
     // stack functions
@@ -240,6 +351,7 @@ struct Cpu {
 
     // functions for addressing
     // lesson from review -> if functions had all same name length (without abstracting meaning too much) code would be much cleaner
+    uint8_t imm();
     uint8_t zpg();
     uint8_t zpgX();
     uint8_t zpgY();
@@ -254,7 +366,14 @@ struct Cpu {
 
     // general instructions
     uint8_t AND();
+    uint8_t BPL();
+    uint8_t BMI();
+    uint8_t BVC();
+    uint8_t BVS();
+    uint8_t BCC();
     uint8_t BCS();
+    uint8_t BNE();
+    uint8_t BEQ();
     uint8_t LDY();
     uint8_t CPX();
     uint8_t CPY();
@@ -277,6 +396,42 @@ struct Cpu {
     uint8_t INC();
     uint8_t JMP();
 
+    // implied and accumulator instructions
+    uint8_t BRK();
+    uint8_t JSR();
+    uint8_t RTI();
+    uint8_t RTS();
+    uint8_t PHP();
+    uint8_t PLP();
+    uint8_t PHA();
+    uint8_t PLA();
+    uint8_t CLC();
+    uint8_t SEC();
+    uint8_t CLI();
+    uint8_t SEI();
+    uint8_t CLV();
+    uint8_t CLD();
+    uint8_t SED();
+    uint8_t DEY();
+    uint8_t INY();
+    uint8_t DEX();
+    uint8_t INX();
+    uint8_t TYA();
+    uint8_t TAY();
+    uint8_t TXA();
+    uint8_t TAX();
+    uint8_t TXS();
+    uint8_t TSX();
+    uint8_t NOP();
+    uint8_t XXX();
+    uint8_t ASL_A();
+    uint8_t ROL_A();
+    uint8_t LSR_A();
+    uint8_t ROR_A();
+
+    // shared by all the branch instructions, adds the cycles of a taken
+    // branch
+    uint8_t branch(bool taken);
 
     // debugger information for disassembler
     // To write the disassembler, it would require the entire
@@ -288,7 +443,7 @@ struct Cpu {
 		uint8_t (Cpu::*addrmode)(void) = nullptr;
 	};
 
-	std::vector<INSTRUCTION> lookup;
+	static const std::vector<INSTRUCTION> lookup;
 };
 
 uint16_t convertTo_16_bit(uint8_t high, uint8_t low);
@@ -41,7 +41,7 @@ void debug_log_cpu(std::ostream &out, Cpu &cpu, Ppu *ppu, bool debugging) {
 
     sInst += hex(addr, 4) + "  " + hex(opcode, 2) + " ";
     status += "A:" + hex(cpu.accumulator, 2) + " X:" + hex(cpu.x, 2) +
-              " Y:" + hex(cpu.y, 2) + " P:" + hex(cpu.status, 2) +
+              " Y:" + hex(cpu.y, 2) + " P:" + hex(cpu.get_status(), 2) +
               " SP:" + hex(cpu.stack_pointer, 2) + ppu_scanlines +
               std::to_string(ppu->scanline) + ppu_cycles +
               std::to_string(ppu->cycle) + " " +
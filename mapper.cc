@@ -0,0 +1,28 @@
+#include "mapper.h"
+#include <cstdint>
+
+// by default a mapper doesn't map anything, the derived mappers override
+// the ranges they handle
+bool Mapper::cpu_read_mapper(uint16_t adr, uint32_t &mapped_adr) {
+  return false;
+}
+
+bool Mapper::cpu_write_mapper(uint16_t adr, uint32_t &mapped_adr,
+                              uint8_t data) {
+  return false;
+}
+
+bool Mapper::ppu_read_mapper(uint16_t adr, uint32_t &mapped_adr) {
+  return false;
+}
+
+bool Mapper::ppu_write_mapper(uint16_t adr, uint32_t &mapped_adr) {
+  return false;
+}
+
+// mappers without registers have nothing to save
+size_t Mapper::state_size() const { return 0; }
+
+void Mapper::save_state(uint8_t *dst) const {}
+
+void Mapper::load_state(const uint8_t *src) {}
@@ -1,6 +1,7 @@
 #ifndef MAPPER
 #define MAPPER
 
+#include <cstddef>
 #include <cstdint>
 #include <utility>
 #define PRG_SWITCH1 std::pair<uint16_t, uint16_t>{0x8000, 0xBFFF}
@@ -29,6 +30,23 @@ class Mapper {
   const virtual Arangement get_name_tbl_argmt() const = 0;
 
   virtual ~Mapper() = default;
+
+  // set whenever the mapper switches banks so the bus can remap its pages,
+  // the bus clears it once it's done
+  bool banks_changed{false};
+
+  // gives the mapper the CPU cycle count, for mappers that care about the
+  // timing of the writes
+  void connect_clock(const uint64_t *cycles) { clock = cycles; }
+
+  // registers of the mapper for save states, save_state writes exactly
+  // state_size() bytes and load_state reads them back
+  virtual size_t state_size() const;
+  virtual void save_state(uint8_t *dst) const;
+  virtual void load_state(const uint8_t *src);
+
+protected:
+  const uint64_t *clock{nullptr};
 };
 
 // Mapper (000) since there are multiple kind of mappers
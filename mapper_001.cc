@@ -1,15 +1,32 @@
 #include "mapper_001.h"
 #include "mapper.h"
 #include <cstdint>
+#include <cstring>
 #include <exception>
 #include <ios>
 #include <iostream>
 #include <map>
 #include <stdexcept>
+#include <type_traits>
 #include <utility>
 
 const Arangement Mapper_001::get_name_tbl_argmt() const { return argmt; }
 
+static_assert(std::is_trivially_copyable_v<Mapper_001State>);
+
+size_t Mapper_001::state_size() const { return sizeof(Mapper_001State); }
+
+void Mapper_001::save_state(uint8_t *dst) const {
+  std::memcpy(dst, static_cast<const Mapper_001State *>(this),
+              sizeof(Mapper_001State));
+}
+
+void Mapper_001::load_state(const uint8_t *src) {
+  std::memcpy(static_cast<Mapper_001State *>(this), src,
+              sizeof(Mapper_001State));
+  banks_changed = true;
+}
+
 void Mapper_001::set_program_mode() {
   prg_bank_mode = (control.prg_bank_high << 1) | control.prg_bank_low;
   if (prg_bank_mode == 0 || prg_bank_mode == 1) {
@@ -19,53 +36,31 @@ void Mapper_001::set_program_mode() {
   }
 }
 
-uint32_t
-Mapper_001::find_prg_mapped_addr(std::pair<uint16_t, uint16_t> &switch_range,
-                                 uint16_t addr) {
-  uint32_t mapped_addr = 0;
-  auto [low, high] = switch_range;
-
-  prg_bank_selected = double_block_mode ? prg.reg & 0x0E : prg.reg & 0x0F;
+void Mapper_001::update_banks() {
   if (double_block_mode) {
-    prg_bank_selected >>= 1;
-  }
-
-  if (!double_block_mode) {
-    if (low <= addr && addr <= high) {
-      mapped_addr = (addr - low) + PRG_BANK_SIZE * prg_bank_selected;
-    } else if (prg_bank_mode == 2) {
-      mapped_addr = addr - PRG_SWITCH1.first;
-    } else if (prg_bank_mode == 3) {
-      mapped_addr =
-          (addr - PRG_SWITCH2.first) + (nPRGBanks - 1) * PRG_BANK_SIZE;
+    // a single 32KB bank, the lowest bit of the register is ignored
+    prg_bank_selected = (prg.reg & 0x0E) >> 1;
+    prg_offset[0] = (PRG_BANK_SIZE * 2) * prg_bank_selected;
+    prg_offset[1] = prg_offset[0] + PRG_BANK_SIZE;
+  } else {
+    prg_bank_selected = prg.reg & 0x0F;
+    if (prg_bank_mode == 2) {
+      // first bank fixed at 0x8000, 0xC000 switches
+      prg_offset[0] = 0;
+      prg_offset[1] = PRG_BANK_SIZE * prg_bank_selected;
     } else {
-      throw std::runtime_error(
-          "Trying to switch individual bank in double block mode");
+      // 0x8000 switches, last bank fixed at 0xC000
+      prg_offset[0] = PRG_BANK_SIZE * prg_bank_selected;
+      prg_offset[1] = (nPRGBanks - 1) * PRG_BANK_SIZE;
     }
-  } else {
-    mapped_addr =
-        (addr - PRG_SWITCH1.first) + (PRG_BANK_SIZE * 2) * prg_bank_selected;
   }
 
-  return mapped_addr;
-}
-
-uint32_t Mapper_001::find_chr_mapped_addr(uint16_t addr) {
   if (chr_bank_mode == 0x01) {
-    if (CHR_SWITCH1.first <= addr && addr <= CHR_SWITCH1.second) {
-      return (addr - CHR_SWITCH1.first) +
-             (chr_bank_0.reg & 0x1F) * CHR_BANK_SIZE;
-    } else if (CHR_SWITCH2.first <= addr && addr <= CHR_SWITCH2.second) {
-      return (addr - CHR_SWITCH2.first) +
-             (chr_bank_1.reg & 0x1F) * CHR_BANK_SIZE;
-    } else {
-      std::cout << "Address should not be out of the range of the switch "
-                   "intervals for CHR\n";
-      // TODO: throw error?
-      return 0;
-    }
+    chr_offset[0] = (chr_bank_0.reg & 0x1F) * CHR_BANK_SIZE;
+    chr_offset[1] = (chr_bank_1.reg & 0x1F) * CHR_BANK_SIZE;
   } else {
-    return (addr - CHR_SWITCH1.first) + (chr_bank_0.reg & 0x1E) * CHR_BANK_SIZE;
+    chr_offset[0] = (chr_bank_0.reg & 0x1E) * CHR_BANK_SIZE;
+    chr_offset[1] = chr_offset[0] + CHR_BANK_SIZE;
   }
 }
 
@@ -80,6 +75,8 @@ void Mapper_001::write_to_register(uint16_t adr, uint8_t val) {
     chr_bank_mode = control.chr_bank;
     set_program_mode();
     find_argmt();
+    update_banks();
+    banks_changed = true;
     return;
   }
   uint8_t bit = val & 0x01;
@@ -118,6 +115,8 @@ void Mapper_001::write_to_register(uint16_t adr, uint8_t val) {
 
     cnt = 0;
     shift.reg = 0x00;
+    update_banks();
+    banks_changed = true;
     return;
   }
   cnt++;
@@ -135,6 +134,7 @@ Mapper_001::Mapper_001(uint8_t nPRGBanks, uint8_t nCHRBanks, uint8_t argmt)
     this->argmt = Arangement::HORIZONTAL;
     break;
   }
+  update_banks();
 }
 
 bool Mapper_001::cpu_read_mapper(uint16_t adr, uint32_t &mapped_adr) {
@@ -143,10 +143,7 @@ bool Mapper_001::cpu_read_mapper(uint16_t adr, uint32_t &mapped_adr) {
   }
 
   if (adr >= 0x8000) {
-    std::pair<uint16_t, uint16_t> range =
-        prg_bank_mode == 2 ? PRG_SWITCH2 : PRG_SWITCH1;
-    mapped_adr = find_prg_mapped_addr(range, adr);
-
+    mapped_adr = prg_offset[(adr >> 14) & 0x01] + (adr & 0x3FFF);
     return true;
   }
 
@@ -159,10 +156,14 @@ bool Mapper_001::cpu_write_mapper(uint16_t adr, uint32_t &mapped_adr,
     std::runtime_error("NOT implemented yet\n");
   }
 
-  if (prev_written && !(0x80 & data))
+  // MMC1 ignores a write that directly follows another one, which can only
+  // happen when they are done by the same instruction
+  if (clock && *clock == last_write && !(0x80 & data))
     return false;
 
   if (adr >= 0x8000) {
+    if (clock)
+      last_write = *clock;
     if (count % 10000 == 0) {
       /* std::cout << "CONTROL " << std::hex << static_cast<uint16_t>(control.reg) */
       /*           << "\n"; */
@@ -175,10 +176,7 @@ bool Mapper_001::cpu_write_mapper(uint16_t adr, uint32_t &mapped_adr,
     }
     count++;
     write_to_register(adr, data);
-
-    std::pair<uint16_t, uint16_t> range =
-        prg_bank_mode == 2 ? PRG_SWITCH2 : PRG_SWITCH1;
-    mapped_adr = find_prg_mapped_addr(range, adr);
+    mapped_adr = prg_offset[(adr >> 14) & 0x01] + (adr & 0x3FFF);
 
     return true;
   }
@@ -189,7 +187,7 @@ bool Mapper_001::cpu_write_mapper(uint16_t adr, uint32_t &mapped_adr,
 bool Mapper_001::ppu_read_mapper(uint16_t adr, uint32_t &mapped_adr) {
   if (0x1FFF < adr || adr < 0x0000)
     return false;
-  mapped_adr = find_chr_mapped_addr(adr);
+  mapped_adr = chr_offset[(adr >> 12) & 0x01] + (adr & 0x0FFF);
 
   return true;
 }
@@ -6,19 +6,9 @@
 class Cartridge; // Forward declaration
 class TestMapper_001;
 
-class Mapper_001 : public Mapper {
-public:
-  bool cpu_read_mapper(uint16_t adr, uint32_t &mapped_adr) override;
-  bool cpu_write_mapper(uint16_t adr, uint32_t &mapped_adr,
-                        uint8_t data) override;
-  bool ppu_read_mapper(uint16_t adr, uint32_t &mapped_adr) override;
-  bool ppu_write_mapper(uint16_t adr, uint32_t &mapped_adr) override;
-  const Arangement get_name_tbl_argmt() const override;
-  virtual ~Mapper_001() {}
-
-  // NOTE: this is temporary, and just for testing
-  // It should be private
-  Mapper_001(uint8_t nPRGBanks, uint8_t nCHRBanks, uint8_t argmt);
+// the registers of the mapper, kept in one plain struct so save states can
+// copy them in one go
+struct Mapper_001State {
   union BANK {
     uint8_t reg;
     struct {
@@ -29,9 +19,9 @@ public:
       uint8_t bit5 : 1;
       uint8_t unused : 3;
     };
-  } chr_bank_0;
+  } chr_bank_0{};
 
-  BANK prg;
+  BANK prg{};
 
   union CTRL {
     uint8_t reg;
@@ -43,25 +33,24 @@ public:
       uint8_t chr_bank : 1;
       uint8_t unused : 3;
     };
-  } control;
+  } control{};
 
-private:
-  Arangement argmt;
-  uint8_t nPRGBanks;
-  uint8_t nCHRBanks;
+protected:
+  Arangement argmt{Arangement::VERTICAL};
 
   // The unused bits for CTRL and BANK are used for counting how many
   // writes have occured for each area of memory. When 5 writes occur,
   // it is wrapped back to 0, indicating the first bit will be overwritten
 
 
-  BANK chr_bank_1;
+  BANK chr_bank_1{};
 
-  BANK shift;
+  BANK shift{};
   int cnt = 0;
 
-  int count;
-  bool prev_written = false;
+  int count = 0;
+  // CPU cycle of the last write that reached the registers
+  uint64_t last_write{~0ull};
 
   // Double block mode is just if we're using the 2 blocks of memory in the 32KB
   // of the RAM (i.e. bank mode set to 0/1)
@@ -74,12 +63,38 @@ private:
   // 1 (switch 2 seperate 4 KB banks) or 0 (switch 1 8 KB bank at a time)
   uint8_t chr_bank_mode = 0x00;
 
+  // where each 16KB half of 0x8000-0xFFFF and each 4KB half of the pattern
+  // memory starts in the ROM. Worked out again whenever a register changes
+  uint32_t prg_offset[2]{};
+  uint32_t chr_offset[2]{};
+};
+
+class Mapper_001 : public Mapper, public Mapper_001State {
+public:
+  bool cpu_read_mapper(uint16_t adr, uint32_t &mapped_adr) override;
+  bool cpu_write_mapper(uint16_t adr, uint32_t &mapped_adr,
+                        uint8_t data) override;
+  bool ppu_read_mapper(uint16_t adr, uint32_t &mapped_adr) override;
+  bool ppu_write_mapper(uint16_t adr, uint32_t &mapped_adr) override;
+  const Arangement get_name_tbl_argmt() const override;
+  size_t state_size() const override;
+  void save_state(uint8_t *dst) const override;
+  void load_state(const uint8_t *src) override;
+  virtual ~Mapper_001() {}
+
+  // NOTE: this is temporary, and just for testing
+  // It should be private
+  Mapper_001(uint8_t nPRGBanks, uint8_t nCHRBanks, uint8_t argmt);
+
+private:
+  uint8_t nPRGBanks;
+  uint8_t nCHRBanks;
+
   void write_to_register(uint16_t adr, uint8_t bit);
   void write_to_control_register(uint8_t value);
   void set_program_mode();
-  uint32_t find_prg_mapped_addr(std::pair<uint16_t, uint16_t> &switch_range,
-                                uint16_t addr);
-  uint32_t find_chr_mapped_addr(uint16_t addr);
+  // works out the offsets of the banks from the registers
+  void update_banks();
   void find_argmt();
 
   friend class Cartridge;
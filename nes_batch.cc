@@ -0,0 +1,102 @@
+#include "nes_batch.h"
+#include "bus.h"
+#include "cartridge.h"
+#include <algorithm>
+#include <cstdint>
+#include <memory>
+#include <stdexcept>
+
+NesBatch::NesBatch(const std::string &rom, size_t count, unsigned threads) {
+  if (count == 0)
+    throw std::runtime_error("A batch needs at least one console");
+
+  for (size_t i = 0; i < count; i++) {
+    consoles.push_back(std::make_unique<Bus>());
+    consoles.back()->insert_card(std::make_unique<Cartridge>(rom));
+    consoles.back()->ppu.render_mode = RenderMode::SCANLINE;
+    consoles.back()->reset();
+  }
+
+  if (threads == 0)
+    threads = std::max(1u, std::thread::hardware_concurrency());
+  nthreads = std::min<size_t>(threads, count);
+  ranges = std::make_unique<Range[]>(nthreads);
+  for (unsigned id = 1; id < nthreads; id++)
+    workers.emplace_back(&NesBatch::worker, this, id);
+}
+
+NesBatch::~NesBatch() {
+  {
+    std::lock_guard<std::mutex> lock{mutex};
+    stopping = true;
+  }
+  start_cv.notify_all();
+  for (std::thread &thread : workers)
+    thread.join();
+}
+
+void NesBatch::reset() {
+  for (auto &console : consoles)
+    console->reset();
+}
+
+void NesBatch::step(const uint8_t *b) {
+  // each thread starts with an equal share of the consoles
+  size_t count = consoles.size();
+  for (unsigned id = 0; id < nthreads; id++) {
+    ranges[id].next.store(count * id / nthreads, std::memory_order_relaxed);
+    ranges[id].end = count * (id + 1) / nthreads;
+  }
+
+  {
+    std::lock_guard<std::mutex> lock{mutex};
+    buttons = b;
+    error = nullptr;
+    busy = nthreads - 1;
+    generation++;
+  }
+  start_cv.notify_all();
+
+  run_ranges(0);
+
+  std::unique_lock<std::mutex> lock{mutex};
+  done_cv.wait(lock, [this] { return busy == 0; });
+  if (error)
+    std::rethrow_exception(error);
+}
+
+void NesBatch::worker(unsigned id) {
+  uint64_t seen = 0;
+  std::unique_lock<std::mutex> lock{mutex};
+  while (true) {
+    start_cv.wait(lock, [&] { return stopping || generation != seen; });
+    if (stopping)
+      return;
+    seen = generation;
+
+    lock.unlock();
+    run_ranges(id);
+    lock.lock();
+
+    if (--busy == 0)
+      done_cv.notify_one();
+  }
+}
+
+void NesBatch::run_ranges(unsigned id) {
+  for (unsigned k = 0; k < nthreads; k++) {
+    Range &range = ranges[(id + k) % nthreads];
+    size_t i;
+    while ((i = range.next.fetch_add(1, std::memory_order_relaxed)) <
+           range.end) {
+      try {
+        consoles[i]->controller.set_buttons(buttons[i]);
+        consoles[i]->run_frame();
+      } catch (...) {
+        std::lock_guard<std::mutex> lock{mutex};
+        if (!error)
+          error = std::current_exception();
+      }
+    }
+  }
+}
@@ -0,0 +1,67 @@
+#ifndef NES_BATCH_H
+#define NES_BATCH_H
+
+#include "bus.h"
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// a number of consoles running the same game, all stepped one frame at a
+// time by a pool of threads. Meant for running lots of independent games at
+// once, like when training agents
+class NesBatch {
+public:
+  // threads includes the thread calling step, 0 uses one per core
+  NesBatch(const std::string &rom, size_t consoles, unsigned threads = 0);
+  ~NesBatch();
+
+  size_t size() const { return consoles.size(); }
+  void reset();
+  // gives console i the buttons in buttons[i] and runs every console for a
+  // frame. Rethrows the first exception a console threw, if any
+  void step(const uint8_t *buttons);
+
+  // views straight into the consoles, they stay valid but change with the
+  // next call to step
+  // the picture as 256 color indexes per scanline, see Ppu::get_frame
+  const uint8_t *frame(size_t i) const { return consoles[i]->ppu.get_frame(); }
+  const uint8_t *ram(size_t i) const { return consoles[i]->cpu_ram; }
+  Bus &console(size_t i) { return *consoles[i]; }
+
+private:
+  // the consoles a thread starts with. Once it is done with them it takes
+  // what is left of the other threads' ranges
+  struct Range {
+    std::atomic<size_t> next{0};
+    size_t end{0};
+  };
+
+  std::vector<std::unique_ptr<Bus>> consoles;
+  std::unique_ptr<Range[]> ranges;
+  unsigned nthreads;
+  // the threads besides the one calling step
+  std::vector<std::thread> workers;
+
+  std::mutex mutex;
+  std::condition_variable start_cv;
+  std::condition_variable done_cv;
+  // goes up with every step so the workers know there is a new frame to run
+  uint64_t generation{0};
+  unsigned busy{0};
+  bool stopping{false};
+  const uint8_t *buttons{nullptr};
+  std::exception_ptr error;
+
+  void worker(unsigned id);
+  // runs the consoles of the range of thread id and then helps the others
+  void run_ranges(unsigned id);
+};
+
+#endif
@@ -0,0 +1,139 @@
+// Headless benchmark, runs a ROM for a number of frames without displaying
+// anything and reports how fast the emulation went
+//
+// usage: nesbench <rom> [-n frames] [--scanline] [--ppu-thread] [--json]
+
+#include "bus.h"
+#include "cartridge.h"
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <exception>
+#include <iostream>
+#include <memory>
+#include <string>
+
+#ifdef _WIN32
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#endif
+
+namespace {
+
+// peak resident memory of the process in KB
+long peak_rss_kb() {
+#ifdef _WIN32
+  PROCESS_MEMORY_COUNTERS counters;
+  if (!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+    return 0;
+  return counters.PeakWorkingSetSize / 1024;
+#else
+  struct rusage usage;
+  if (getrusage(RUSAGE_SELF, &usage) != 0)
+    return 0;
+#ifdef __APPLE__
+  // macOS reports it in bytes
+  return usage.ru_maxrss / 1024;
+#else
+  return usage.ru_maxrss;
+#endif
+#endif
+}
+
+// rom paths on Windows are full of backslashes
+std::string json_escape(const std::string &s) {
+  std::string out;
+  for (char c : s) {
+    if (c == '"' || c == '\\')
+      out += '\\';
+    out += c;
+  }
+  return out;
+}
+
+void usage() {
+  std::cerr << "usage: nesbench <rom> [-n frames] [--scanline] [--ppu-thread] "
+               "[--json]\n";
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  std::string rom;
+  long frames = 600;
+  bool scanline = false;
+  bool ppu_thread = false;
+  bool json = false;
+
+  for (int i = 1; i < argc; i++) {
+    if (std::strcmp(argv[i], "-n") == 0 && i + 1 < argc) {
+      frames = std::strtol(argv[++i], nullptr, 10);
+    } else if (std::strcmp(argv[i], "--scanline") == 0) {
+      scanline = true;
+    } else if (std::strcmp(argv[i], "--ppu-thread") == 0) {
+      ppu_thread = true;
+    } else if (std::strcmp(argv[i], "--json") == 0) {
+      json = true;
+    } else if (argv[i][0] != '-' && rom.empty()) {
+      rom = argv[i];
+    } else {
+      usage();
+      return 1;
+    }
+  }
+  if (rom.empty() || frames <= 0) {
+    usage();
+    return 1;
+  }
+
+  auto nes = std::make_unique<Bus>();
+  try {
+    nes->insert_card(std::make_unique<Cartridge>(rom));
+  } catch (const std::exception &e) {
+    std::cerr << "nesbench: " << rom << ": " << e.what();
+    return 1;
+  }
+  if (scanline)
+    nes->ppu.render_mode = RenderMode::SCANLINE;
+  nes->reset();
+  nes->set_ppu_thread(ppu_thread);
+
+  uint64_t start_cycles = nes->cpu.total_cycles;
+  uint64_t start_dots = nes->ppu_dots();
+  auto start = std::chrono::steady_clock::now();
+
+  for (long i = 0; i < frames; i++)
+    nes->run_frame();
+
+  double seconds =
+      std::chrono::duration<double>(std::chrono::steady_clock::now() - start)
+          .count();
+  uint64_t cycles = nes->cpu.total_cycles - start_cycles;
+  uint64_t dots = nes->ppu_dots() - start_dots;
+
+  double cycles_per_sec = cycles / seconds;
+  double dots_per_sec = dots / seconds;
+  double fps = frames / seconds;
+  long rss = peak_rss_kb();
+
+  if (json) {
+    std::printf("{\"rom\": \"%s\", \"frames\": %ld, \"seconds\": %.6f, "
+                "\"cpu_cycles\": %llu, \"ppu_dots\": %llu, "
+                "\"cpu_cycles_per_sec\": %.0f, \"ppu_dots_per_sec\": %.0f, "
+                "\"fps\": %.2f, \"peak_rss_kb\": %ld}\n",
+                json_escape(rom).c_str(), frames, seconds,
+                (unsigned long long)cycles,
+                (unsigned long long)dots, cycles_per_sec, dots_per_sec, fps,
+                rss);
+  } else {
+    std::printf("%s: %ld frames in %.3f s\n", rom.c_str(), frames, seconds);
+    std::printf("  cpu cycles/s %14.0f\n", cycles_per_sec);
+    std::printf("  ppu dots/s   %14.0f\n", dots_per_sec);
+    std::printf("  frames/s     %14.2f\n", fps);
+    std::printf("  peak rss     %11ld KB\n", rss);
+  }
+  return 0;
+}
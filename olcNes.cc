@@ -1,5 +1,6 @@
 #include <cassert>
 #include <cstdint>
+#include <cstring>
 #include <ios>
 #include <iostream>
 #include <memory>
@@ -11,6 +12,8 @@
 #include "bus.h"
 #include "cartridge.h"
 #include "cpu.h"
+#include "rewind.h"
+#include "sdl_input.h"
 #define OLC_PGE_APPLICATION
 #define OLC_ENABLE_EXPERIMENTATION
 #include "olcPixelGameEngine.h"
@@ -20,8 +23,22 @@ public:
   Debugger() { sAppName = "Debugger"; }
 
   Bus nes; // Bus is the NES
+  // the last minute of frames, played back while backspace is held
+  Rewind rewind{nes};
+
+  // frames emulated ahead of the one that is shown, to hide the input lag
+  // of the game. Each one costs a whole extra frame of emulation
+  int run_ahead = 0;
+  std::vector<uint8_t> run_ahead_state;
   std::map<uint16_t, std::string> mapAsm;
 
+  // publishes the joystick and keyboard buttons to the controller
+  std::unique_ptr<SdlInput> input;
+
+  // the PPU only gives raw pixels, they are copied in these to be drawn
+  olc::Sprite sprScreen{256, 240};
+  olc::Sprite sprPatternTable[2]{{128, 128}, {128, 128}};
+
   // if run_emulation is true, debugging mode is off
   bool run_emulation = false;
   int step_size = 128;
@@ -51,25 +68,32 @@ public:
     }
   }
 
+  // copies the pixels from the PPU into a sprite, they have the same layout
+  olc::Sprite *to_sprite(olc::Sprite &sprite, const uint32_t *pixels) {
+    std::memcpy(sprite.GetData(), pixels,
+                sprite.width * sprite.height * sizeof(uint32_t));
+    return &sprite;
+  }
+
   void DrawCpu(int x, int y) {
     std::string status = "STATUS: ";
     DrawString(x, y, "STATUS:", olc::WHITE);
     DrawString(x + 64, y, "N",
-               nes.cpu.status & FLAGS::N ? olc::GREEN : olc::RED);
+               nes.cpu.get_status() & FLAGS::N ? olc::GREEN : olc::RED);
     DrawString(x + 80, y, "V",
-               nes.cpu.status & FLAGS::V ? olc::GREEN : olc::RED);
+               nes.cpu.get_status() & FLAGS::V ? olc::GREEN : olc::RED);
     DrawString(x + 96, y, "-",
-               nes.cpu.status & FLAGS::U ? olc::GREEN : olc::RED);
+               nes.cpu.get_status() & FLAGS::U ? olc::GREEN : olc::RED);
     DrawString(x + 112, y, "B",
-               nes.cpu.status & FLAGS::B ? olc::GREEN : olc::RED);
+               nes.cpu.get_status() & FLAGS::B ? olc::GREEN : olc::RED);
     DrawString(x + 128, y, "D",
-               nes.cpu.status & FLAGS::D ? olc::GREEN : olc::RED);
+               nes.cpu.get_status() & FLAGS::D ? olc::GREEN : olc::RED);
     DrawString(x + 144, y, "I",
-               nes.cpu.status & FLAGS::I ? olc::GREEN : olc::RED);
+               nes.cpu.get_status() & FLAGS::I ? olc::GREEN : olc::RED);
     DrawString(x + 160, y, "Z",
-               nes.cpu.status & FLAGS::Z ? olc::GREEN : olc::RED);
+               nes.cpu.get_status() & FLAGS::Z ? olc::GREEN : olc::RED);
     DrawString(x + 178, y, "C",
-               nes.cpu.status & FLAGS::C ? olc::GREEN : olc::RED);
+               nes.cpu.get_status() & FLAGS::C ? olc::GREEN : olc::RED);
     DrawString(x, y + 10, "PC: $" + hex(nes.cpu.PC, 4));
     DrawString(x, y + 20,
                "A: $" + hex(nes.cpu.accumulator, 2) + "  [" +
@@ -111,6 +135,8 @@ public:
   bool OnUserCreate() {
     auto card = std::make_unique<Cartridge>("Super Mario Bros (E).nes");
     nes.insert_card(std::move(card));
+    nes.ppu.render_mode = RenderMode::SCANLINE;
+    input = std::make_unique<SdlInput>(nes.controller);
 
     /* mapAsm = nes.cpu.disassemble(0xC000, 0xFFFF); */
 
@@ -119,8 +145,44 @@ public:
     return true;
   }
 
+  // runs the next frame, with the frames that are run ahead if there are
+  // any. The frame that is shown is run_ahead frames later than the one the
+  // game is at, with the buttons that are pressed now
+  void run_frame() {
+    if (run_ahead == 0) {
+      nes.run_frame();
+      return;
+    }
+
+    nes.ppu.video_output = false;
+    nes.run_frame();
+    nes.save_state(run_ahead_state);
+    for (int i = 1; i < run_ahead; i++)
+      nes.run_frame();
+    nes.ppu.video_output = true;
+    nes.run_frame();
+    nes.load_state(run_ahead_state);
+  }
+
+  // the keyboard is read once per frame of the app
+  // arrows for the d-pad, X for A, Z for B, Enter for start and Shift for
+  // select, the other keys are used by the debugger
+  uint8_t read_keyboard() {
+    Controller::Input keys{0x00};
+    keys.up = GetKey(olc::Key::UP).bHeld;
+    keys.down = GetKey(olc::Key::DOWN).bHeld;
+    keys.left = GetKey(olc::Key::LEFT).bHeld;
+    keys.right = GetKey(olc::Key::RIGHT).bHeld;
+    keys.a_button = GetKey(olc::Key::X).bHeld;
+    keys.b_button = GetKey(olc::Key::Z).bHeld;
+    keys.start = GetKey(olc::Key::ENTER).bHeld;
+    keys.select = GetKey(olc::Key::SHIFT).bHeld;
+    return keys.reg;
+  }
+
   bool OnUserUpdate(float fElapsedTime) {
     Clear(olc::DARK_BLUE);
+    input->set_keyboard(read_keyboard());
     // if emulation is playing without debug mode
     if (run_emulation) {
       // run the emulation, clocking as fast as possible\
@@ -134,11 +196,15 @@ public:
       else {
         fResidualTime =
             (1.0f / 60.0f) - fElapsedTime; // Substract ElapsedTime for accuracy
-        do {
-
-          nes.clock();
-        } while (!nes.ppu.frame_complete);
-        nes.ppu.frame_complete = false;
+        if (GetKey(olc::Key::BACK).bHeld) {
+          // save states don't keep the picture, so the frame after the one
+          // that was loaded is run again to have something to show
+          if (rewind.pop())
+            nes.run_frame();
+        } else {
+          run_frame();
+          rewind.push();
+        }
       }
     }
 
@@ -207,12 +273,19 @@ public:
 
     }
 
-    if (GetKey(olc::Key::R).bPressed)
+    if (GetKey(olc::Key::R).bPressed) {
       nes.reset();
+      rewind.clear();
+    }
 
     if (GetKey(olc::Key::SPACE).bPressed)
       run_emulation = !run_emulation;
 
+    if (GetKey(olc::Key::A).bPressed) {
+      run_ahead = (run_ahead + 1) % 3;
+      std::cout << "Running " << run_ahead << " frames ahead\n";
+    }
+
     if (GetKey(olc::Key::P).bPressed)
       // not sure why we wrap around with
       // 0x07 and not 0x03
@@ -225,17 +298,22 @@ public:
     for (int p = 0; p < 8; p++)   // For each palette
       for (int s = 0; s < 4; s++) // For each index
         FillRect(516 + p * (nSwatchSize * 5) + s * nSwatchSize, 345,
-                 nSwatchSize, nSwatchSize, nes.ppu.get_palette_color(p, s));
+                 nSwatchSize, nSwatchSize,
+                 olc::Pixel(nes.ppu.get_palette_color(p, s)));
 
     // Draw selection reticule around selected palette
     // DrawRect(516 + selected_palette * (nSwatchSize * 5) - 1, 339,
     //         (nSwatchSize * 4), nSwatchSize, olc::WHITE);
 
     // Generate Pattern Tables
-    DrawSprite(516, 352, &nes.ppu.getpatternTable(0, selected_palette));
-    DrawSprite(648, 352, &nes.ppu.getpatternTable(1, selected_palette));
-
-    DrawSprite(0, 0, nes.ppu.getScreen(), 2);
+    DrawSprite(516, 352,
+               to_sprite(sprPatternTable[0],
+                         nes.ppu.getpatternTable(0, selected_palette)));
+    DrawSprite(648, 352,
+               to_sprite(sprPatternTable[1],
+                         nes.ppu.getpatternTable(1, selected_palette)));
+
+    DrawSprite(0, 0, to_sprite(sprScreen, nes.ppu.getScreen()), 2);
     return true;
   }
 };
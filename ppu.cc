@@ -5,88 +5,111 @@
 #include "mapper.h"
 #include <algorithm>
 #include <cstdint>
-#include <float.h>
+#include <cstring>
 #include <ios>
 #include <iostream>
 #include <memory>
-#include <winnt.h>
+
+namespace {
+constexpr uint32_t rgb(uint8_t r, uint8_t g, uint8_t b) {
+  return 0xFF000000 | (b << 16) | (g << 8) | r;
+}
+} // namespace
 
 Ppu::Ppu()
-    : sprNameTable(2), sprPatternTable(2), oam(256), frame_complete(false) {
+    : screen(256 * 240) {
   // color palette for the screen
-  palScreen[0x00] = olc::Pixel(84, 84, 84);
-  palScreen[0x01] = olc::Pixel(0, 30, 116);
-  palScreen[0x02] = olc::Pixel(8, 16, 144);
-  palScreen[0x03] = olc::Pixel(48, 0, 136);
-  palScreen[0x04] = olc::Pixel(68, 0, 100);
-  palScreen[0x05] = olc::Pixel(92, 0, 48);
-  palScreen[0x06] = olc::Pixel(84, 4, 0);
-  palScreen[0x07] = olc::Pixel(60, 24, 0);
-  palScreen[0x08] = olc::Pixel(32, 42, 0);
-  palScreen[0x09] = olc::Pixel(8, 58, 0);
-  palScreen[0x0A] = olc::Pixel(0, 64, 0);
-  palScreen[0x0B] = olc::Pixel(0, 60, 0);
-  palScreen[0x0C] = olc::Pixel(0, 50, 60);
-  palScreen[0x0D] = olc::Pixel(0, 0, 0);
-  palScreen[0x0E] = olc::Pixel(0, 0, 0);
-  palScreen[0x0F] = olc::Pixel(0, 0, 0);
-
-  palScreen[0x10] = olc::Pixel(152, 150, 152);
-  palScreen[0x11] = olc::Pixel(8, 76, 196);
-  palScreen[0x12] = olc::Pixel(48, 50, 236);
-  palScreen[0x13] = olc::Pixel(92, 30, 228);
-  palScreen[0x14] = olc::Pixel(136, 20, 176);
-  palScreen[0x15] = olc::Pixel(160, 20, 100);
-  palScreen[0x16] = olc::Pixel(152, 34, 32);
-  palScreen[0x17] = olc::Pixel(120, 60, 0);
-  palScreen[0x18] = olc::Pixel(84, 90, 0);
-  palScreen[0x19] = olc::Pixel(40, 114, 0);
-  palScreen[0x1A] = olc::Pixel(8, 124, 0);
-  palScreen[0x1B] = olc::Pixel(0, 118, 40);
-  palScreen[0x1C] = olc::Pixel(0, 102, 120);
-  palScreen[0x1D] = olc::Pixel(0, 0, 0);
-  palScreen[0x1E] = olc::Pixel(0, 0, 0);
-  palScreen[0x1F] = olc::Pixel(0, 0, 0);
-
-  palScreen[0x20] = olc::Pixel(236, 238, 236);
-  palScreen[0x21] = olc::Pixel(76, 154, 236);
-  palScreen[0x22] = olc::Pixel(120, 124, 236);
-  palScreen[0x23] = olc::Pixel(176, 98, 236);
-  palScreen[0x24] = olc::Pixel(228, 84, 236);
-  palScreen[0x25] = olc::Pixel(236, 88, 180);
-  palScreen[0x26] = olc::Pixel(236, 106, 100);
-  palScreen[0x27] = olc::Pixel(212, 136, 32);
-  palScreen[0x28] = olc::Pixel(160, 170, 0);
-  palScreen[0x29] = olc::Pixel(116, 196, 0);
-  palScreen[0x2A] = olc::Pixel(76, 208, 32);
-  palScreen[0x2B] = olc::Pixel(56, 204, 108);
-  palScreen[0x2C] = olc::Pixel(56, 180, 204);
-  palScreen[0x2D] = olc::Pixel(60, 60, 60);
-  palScreen[0x2E] = olc::Pixel(0, 0, 0);
-  palScreen[0x2F] = olc::Pixel(0, 0, 0);
-
-  palScreen[0x30] = olc::Pixel(236, 238, 236);
-  palScreen[0x31] = olc::Pixel(168, 204, 236);
-  palScreen[0x32] = olc::Pixel(188, 188, 236);
-  palScreen[0x33] = olc::Pixel(212, 178, 236);
-  palScreen[0x34] = olc::Pixel(236, 174, 236);
-  palScreen[0x35] = olc::Pixel(236, 174, 212);
-  palScreen[0x36] = olc::Pixel(236, 180, 176);
-  palScreen[0x37] = olc::Pixel(228, 196, 144);
-  palScreen[0x38] = olc::Pixel(204, 210, 120);
-  palScreen[0x39] = olc::Pixel(180, 222, 120);
-  palScreen[0x3A] = olc::Pixel(168, 226, 144);
-  palScreen[0x3B] = olc::Pixel(152, 226, 180);
-  palScreen[0x3C] = olc::Pixel(160, 214, 228);
-  palScreen[0x3D] = olc::Pixel(160, 162, 160);
-  palScreen[0x3E] = olc::Pixel(0, 0, 0);
-  palScreen[0x3F] = olc::Pixel(0, 0, 0);
-
-  sprScreen = std::make_unique<olc::Sprite>(256, 240);
-  sprNameTable[0] = std::make_unique<olc::Sprite>(256, 240);
-  sprNameTable[1] = std::make_unique<olc::Sprite>(256, 240);
-  sprPatternTable[0] = std::make_unique<olc::Sprite>(128, 128);
-  sprPatternTable[1] = std::make_unique<olc::Sprite>(128, 128);
+  palScreen[0x00] = rgb(84, 84, 84);
+  palScreen[0x01] = rgb(0, 30, 116);
+  palScreen[0x02] = rgb(8, 16, 144);
+  palScreen[0x03] = rgb(48, 0, 136);
+  palScreen[0x04] = rgb(68, 0, 100);
+  palScreen[0x05] = rgb(92, 0, 48);
+  palScreen[0x06] = rgb(84, 4, 0);
+  palScreen[0x07] = rgb(60, 24, 0);
+  palScreen[0x08] = rgb(32, 42, 0);
+  palScreen[0x09] = rgb(8, 58, 0);
+  palScreen[0x0A] = rgb(0, 64, 0);
+  palScreen[0x0B] = rgb(0, 60, 0);
+  palScreen[0x0C] = rgb(0, 50, 60);
+  palScreen[0x0D] = rgb(0, 0, 0);
+  palScreen[0x0E] = rgb(0, 0, 0);
+  palScreen[0x0F] = rgb(0, 0, 0);
+
+  palScreen[0x10] = rgb(152, 150, 152);
+  palScreen[0x11] = rgb(8, 76, 196);
+  palScreen[0x12] = rgb(48, 50, 236);
+  palScreen[0x13] = rgb(92, 30, 228);
+  palScreen[0x14] = rgb(136, 20, 176);
+  palScreen[0x15] = rgb(160, 20, 100);
+  palScreen[0x16] = rgb(152, 34, 32);
+  palScreen[0x17] = rgb(120, 60, 0);
+  palScreen[0x18] = rgb(84, 90, 0);
+  palScreen[0x19] = rgb(40, 114, 0);
+  palScreen[0x1A] = rgb(8, 124, 0);
+  palScreen[0x1B] = rgb(0, 118, 40);
+  palScreen[0x1C] = rgb(0, 102, 120);
+  palScreen[0x1D] = rgb(0, 0, 0);
+  palScreen[0x1E] = rgb(0, 0, 0);
+  palScreen[0x1F] = rgb(0, 0, 0);
+
+  palScreen[0x20] = rgb(236, 238, 236);
+  palScreen[0x21] = rgb(76, 154, 236);
+  palScreen[0x22] = rgb(120, 124, 236);
+  palScreen[0x23] = rgb(176, 98, 236);
+  palScreen[0x24] = rgb(228, 84, 236);
+  palScreen[0x25] = rgb(236, 88, 180);
+  palScreen[0x26] = rgb(236, 106, 100);
+  palScreen[0x27] = rgb(212, 136, 32);
+  palScreen[0x28] = rgb(160, 170, 0);
+  palScreen[0x29] = rgb(116, 196, 0);
+  palScreen[0x2A] = rgb(76, 208, 32);
+  palScreen[0x2B] = rgb(56, 204, 108);
+  palScreen[0x2C] = rgb(56, 180, 204);
+  palScreen[0x2D] = rgb(60, 60, 60);
+  palScreen[0x2E] = rgb(0, 0, 0);
+  palScreen[0x2F] = rgb(0, 0, 0);
+
+  palScreen[0x30] = rgb(236, 238, 236);
+  palScreen[0x31] = rgb(168, 204, 236);
+  palScreen[0x32] = rgb(188, 188, 236);
+  palScreen[0x33] = rgb(212, 178, 236);
+  palScreen[0x34] = rgb(236, 174, 236);
+  palScreen[0x35] = rgb(236, 174, 212);
+  palScreen[0x36] = rgb(236, 180, 176);
+  palScreen[0x37] = rgb(228, 196, 144);
+  palScreen[0x38] = rgb(204, 210, 120);
+  palScreen[0x39] = rgb(180, 222, 120);
+  palScreen[0x3A] = rgb(168, 226, 144);
+  palScreen[0x3B] = rgb(152, 226, 180);
+  palScreen[0x3C] = rgb(160, 214, 228);
+  palScreen[0x3D] = rgb(160, 162, 160);
+  palScreen[0x3E] = rgb(0, 0, 0);
+  palScreen[0x3F] = rgb(0, 0, 0);
+
+  // when some of the emphasis bits are set, the color channels that aren't
+  // emphasized are darkened
+  for (int emphasis = 0; emphasis < 8; emphasis++) {
+    for (int color = 0; color < 0x40; color++) {
+      uint8_t r = palScreen[color] & 0xFF;
+      uint8_t g = (palScreen[color] >> 8) & 0xFF;
+      uint8_t b = (palScreen[color] >> 16) & 0xFF;
+      if (emphasis) {
+        if (!(emphasis & 0x01))
+          r = r * 3 / 4;
+        if (!(emphasis & 0x02))
+          g = g * 3 / 4;
+        if (!(emphasis & 0x04))
+          b = b * 3 / 4;
+      }
+      rgb_lut[(emphasis << 6) | color] = rgb(r, g, b);
+    }
+  }
+  std::fill(std::begin(frame), std::end(frame), 0x00);
+  std::fill(std::begin(frame_emphasis), std::end(frame_emphasis), 0x00);
+
+  pattern_tables[0].resize(128 * 128);
+  pattern_tables[1].resize(128 * 128);
   control.reg = 0x00;
   mask.reg = 0x00;
   status.reg = 0x00;
@@ -97,6 +120,8 @@ Ppu::~Ppu() {}
 // For both cpu_write and cpu_read, the address can
 // only actually be from 0x0000 to 0x0007
 void Ppu::cpu_write(uint16_t adr, uint8_t val) {
+  // every register write can change what the rest of the line looks like
+  catch_up();
   switch (adr) {
   case 0x0000: // control
     control.reg = val;
@@ -161,6 +186,9 @@ void Ppu::cpu_write(uint16_t adr, uint8_t val) {
 // cpu reading from ppu
 uint8_t Ppu::cpu_read(uint16_t adr, bool read) {
   uint8_t data{0x00};
+  // status, OAM data and PPU data depend on how far the rendering got
+  if (adr == 0x0002 || adr == 0x0004 || adr == 0x0007)
+    catch_up();
   switch (adr) {
   case 0x0000:
     break;
@@ -207,21 +235,10 @@ void Ppu::ppu_write(uint16_t adr, uint8_t val) {
     // that bit indicates which pattern table to be accessed
     // background or sprite
     npatterns[(adr & 0x1000) >> 12][adr & 0x0FFF] = val;
+    // the page is decoded again the next time it's used
+    tile_src[adr >> 10] = nullptr;
   } else if (adr >= 0x2000 && adr <= 0x2FFF) {
-    uint8_t name_table_idx = (v & 0x0C00) >> 10;
-    if (card->get_argmt() == Arangement::HORIZONTAL) {
-      if (name_table_idx == 2)
-        name_table_idx = 0;
-      if (name_table_idx == 3)
-        name_table_idx = 1;
-    } else {
-      if (name_table_idx == 1)
-        name_table_idx = 0;
-      if (name_table_idx == 3)
-        name_table_idx = 2;
-    }
-
-    ntables[name_table_idx][(adr & 0x23FF) - 0x2000] = val;
+    nt_page[(adr >> 10) & 0x03][adr & 0x03FF] = val;
   } else if (adr >= 0x3F00 && adr <= 0x3FFF) {
     // This address space is for the palettes
     // we AND the address because it has mirrors
@@ -259,20 +276,7 @@ uint8_t Ppu::ppu_read(uint16_t adr, bool read) {
     // background or sprite
     data = npatterns[(adr & 0x1000) >> 12][adr & 0x0FFF];
   } else if (adr >= 0x2000 && adr <= 0x2FFF) {
-    uint8_t name_table_idx = (v & 0x0C00) >> 10;
-    if (card->get_argmt() == Arangement::HORIZONTAL) {
-      if (name_table_idx == 2)
-        name_table_idx = 0;
-      if (name_table_idx == 3)
-        name_table_idx = 1;
-    } else {
-      if (name_table_idx == 1)
-        name_table_idx = 0;
-      if (name_table_idx == 3)
-        name_table_idx = 2;
-    }
-
-    data = ntables[name_table_idx][(adr & 0x23FF) - 0x2000];
+    data = nt_page[(adr >> 10) & 0x03][adr & 0x03FF];
   } else if (adr >= 0x3F00 && adr <= 0x3FFF) {
     // This address space is for the palettes
     // we AND the address because it has mirrors
@@ -296,59 +300,109 @@ uint8_t Ppu::ppu_read(uint16_t adr, bool read) {
   return data;
 }
 
-olc::Sprite *Ppu::getScreen() const { return sprScreen.get(); }
+const uint32_t *Ppu::getScreen() {
+  // turn the color indexes into pixels, a table lookup per pixel
+  for (int y = 0; y < 240; y++) {
+    const uint32_t *lut = &rgb_lut[frame_emphasis[y] << 6];
+    const uint8_t *line = &frame[y * 256];
+    uint32_t *out_line = &screen[y * 256];
+    for (int x = 0; x < 256; x++)
+      out_line[x] = lut[line[x]];
+  }
+  return screen.data();
+}
 
 // for this function, we'll have to loop through the pattern tables
 // and then through the grid of the tile which will allow us
 // to get the lsb and msb of the pixels
 // we do this by shifting the value of the row of the tile
 //
-olc::Sprite &Ppu::getpatternTable(uint8_t i, uint8_t palette) {
-  for (int pattern_x = 0; pattern_x < 16; pattern_x++) {
-    for (int pattern_y = 0; pattern_y < 16; pattern_y++) {
-      // offset is in bytes, so55 calculating 2D index is considering the bytes
-      // hence multiplying by 256 and 16
-      // using the formula: y * width + x
-      uint16_t offset = pattern_x * 256 + pattern_y * 16;
-      for (int tile_x = 0; tile_x < 8; tile_x++) {
-        uint8_t lsb = ppu_read(0x1000 * i + offset + tile_x, true);
-        // the +8 is required because the rows of the tile
-        // there are 8 rows and every row is stored as a byte
-        // the lsb are stored one after the other, so adding 8 brings
-        // us directly to the msb
-        uint8_t msb = ppu_read(0x1000 * i + offset + tile_x + 8, true);
-
-        for (int tile_y = 0; tile_y < 8; tile_y++) {
-          uint8_t pixel = ((msb & 0x01) << 1) | (lsb & 0x01);
-
-          lsb = lsb >> 1;
-          msb = msb >> 1;
-
-          // we need to scale by 8 since the
-          // sprite size is 128 by 128, and our
-          // pattern table table has 16 tiles
-          // so when we're done with the tile
-          // we move on according to pattern_y and pattern_x
-          // indicating which pattern we're on
-          sprPatternTable[i]->SetPixel(pattern_y * 8 + (7 - tile_y),
-                                       pattern_x * 8 + tile_x,
-                                       get_palette_color(pixel, palette));
-        }
+const uint32_t *Ppu::getpatternTable(uint8_t i, uint8_t palette) {
+  for (int tile_y = 0; tile_y < 16; tile_y++) {
+    for (int tile_x = 0; tile_x < 16; tile_x++) {
+      // tiles are 16 bytes, 16 tiles per row of the table
+      uint16_t offset = 0x1000 * i + tile_y * 256 + tile_x * 16;
+      for (int row = 0; row < 8; row++) {
+        const uint8_t *pixels = tile_row(offset + row, false);
+        // the table is 128 pixels wide
+        uint32_t *out =
+            &pattern_tables[i][(tile_y * 8 + row) * 128 + tile_x * 8];
+        for (int x = 0; x < 8; x++)
+          out[x] = get_palette_color(pixels[x], palette);
+      }
+    }
+  }
+  return pattern_tables[i].data();
+}
+
+const uint8_t *Ppu::tile_row(uint16_t adr, bool flip) {
+  uint8_t page = (adr >> 10) & 0x07;
+  const uint8_t *src = card->chr_page(page);
+  if (!src)
+    src = &npatterns[page >> 2][(page & 0x03) << 10];
+  if (tile_src[page] != src)
+    decode_tiles(page, src);
+
+  uint16_t row = ((adr & 0x03F0) >> 4) * 64 + (adr & 0x07) * 8;
+  return &tile_pixels[flip][page][row];
+}
+
+void Ppu::decode_tiles(uint8_t page, const uint8_t *src) {
+  for (int tile = 0; tile < 64; tile++) {
+    for (int row = 0; row < 8; row++) {
+      // the low bits of the 8 rows come first, then the high bits
+      uint8_t lsb = src[tile * 16 + row];
+      uint8_t msb = src[tile * 16 + row + 8];
+      uint8_t *pixels = &tile_pixels[0][page][tile * 64 + row * 8];
+      uint8_t *flipped = &tile_pixels[1][page][tile * 64 + row * 8];
+      for (int x = 0; x < 8; x++) {
+        uint8_t pixel = (((msb >> (7 - x)) & 0x01) << 1) |
+                        ((lsb >> (7 - x)) & 0x01);
+        pixels[x] = pixel;
+        flipped[7 - x] = pixel;
       }
     }
   }
-  return *sprPatternTable[i];
+  tile_src[page] = src;
+}
+
+void Ppu::invalidate_tiles() {
+  std::fill(std::begin(tile_src), std::end(tile_src), nullptr);
 }
 
-olc::Pixel Ppu::get_palette_color(uint8_t pixel, uint8_t palette) {
+uint32_t Ppu::get_palette_color(uint8_t pixel, uint8_t palette) {
   // we need to multiply by 4 because the palettes have 7 locations where
   // each location stores 4 bytes of types of colors (1 byte for each type)
   // and that gets us the index, then add the pixel to choose which of the 4
   // colors we want
-  return palScreen[ppu_read(0x3F00 + (palette << 2) + pixel) & 0x3F];
+  return palScreen[palette_index(pixel, palette)];
 }
 
-void Ppu::connectCard(Cartridge *c) { card = c; }
+void Ppu::connectCard(Cartridge *c) {
+  card = c;
+  map_nametables();
+}
+
+void Ppu::map_nametables() {
+  // which of the 2 nametables of the PPU each of the 4 the CPU sees uses
+  uint8_t tables[4] = {0, 0, 1, 1};
+  switch (card->get_argmt()) {
+  case Arangement::HORIZONTAL:
+    tables[1] = 1;
+    tables[2] = 0;
+    break;
+  case Arangement::VERTICAL:
+    break;
+  case Arangement::LOWER:
+    tables[2] = tables[3] = 0;
+    break;
+  case Arangement::HIGHER:
+    tables[0] = tables[1] = 1;
+    break;
+  }
+  for (int i = 0; i < 4; i++)
+    nt_page[i] = ntables[tables[i]];
+}
 
 void Ppu::update_render() {
   if (fine_x == 8) {
@@ -384,162 +438,182 @@ void Ppu::update_render() {
     }
   }
 }
-// cycles are the horizontal rendering
-// scanlines vertical (somewhat like rows)
-bool Ppu::clock() {
-  /* Returning 1 indicates that an NMI was triggered
-   * This function handles all the rendering done by the PPU
-   * It renders 8 pixels on a scanline all at once and uses buffer cycles to
-   * keep the timing fine.
-   */
 
-  bool return_val = 0;
+void Ppu::catch_up() {
+  if (scanline < 0 || scanline > 239)
+    return;
 
-  if (scanline >= 0 && scanline <= 239) {
-    uint8_t coarse_x = v & 0b0000000000011111;
-    uint8_t coarse_y = (v & 0b0000001111100000) >> 5;
-    uint8_t fine_y = (v & 0b0111000000000000) >> 12;
-    uint8_t curr_render_y = scanline;
+  int16_t last = std::min<int16_t>(cycle - 1, 256);
+  while (next_dot <= last)
+    render_dot(next_dot++);
+}
 
-    if (cycle >= 1 && cycle <= 256) {
-      // doing this in less cycles because I wanted to
-      if (cycle >= 65 && cycle <= 128) {
-        if (cycle == 65) {
-          clear_secondary_oam();
-        }
+void Ppu::render_dot(int16_t dot) {
+  uint8_t coarse_x = v & 0b0000000000011111;
+  uint8_t coarse_y = (v & 0b0000001111100000) >> 5;
+  uint8_t fine_y = (v & 0b0111000000000000) >> 12;
+  uint8_t curr_render_y = scanline;
 
-        uint8_t sprite_idx = (cycle - 65) * 4;
-        if (oam[sprite_idx] != 0 && oam[sprite_idx] == 127) {
-          /* std::cout << std::hex << static_cast<uint16_t>(oam[sprite_idx + 1]) << "\n"; */
-        }
+  // doing this in less cycles because I wanted to
+  if (dot >= 65 && dot <= 128) {
+    if (dot == 65) {
+      clear_secondary_oam();
+    }
 
-        if (oam[sprite_idx] <= curr_render_y &&
-            curr_render_y <= 7 + oam[sprite_idx]  && secondary_oam.size() < 8) {
-          secondary_oam.push(sprite_idx);
-        } else if (0 <= curr_render_y - oam[sprite_idx] &&
-                   curr_render_y - oam[sprite_idx] <= 7 &&
-                   secondary_oam.size() >= 8) {
-          status.sprite_overflow = true;
-        }
-      }
+    uint8_t sprite_idx = (dot - 65) * 4;
+    if (oam[sprite_idx] != 0 && oam[sprite_idx] == 127) {
+      /* std::cout << std::hex << static_cast<uint16_t>(oam[sprite_idx + 1]) << "\n"; */
+    }
 
-      if ((cycle - 1) % 8 == 0) {
-
-        // we need to actually render the things
-        // increment cycle clock by 2 after each fetching
-        // render the thing
-        // These are the addresses that must be read from the nametable or
-        // attribute table to get the necessary info
-        tile_adr = 0x2000 | (v & 0x0FFF);
-        attribute_adress =
-            0x23C0 | (v & 0x0C00) | ((v >> 4) & 0x38) | ((v >> 2) & 0x07);
-
-        // can be reduced to 4 reads like the "real" NES, but this is fine too
-        // memmory accesses by the ppu to get information to render (8 cycles
-        // total)
-        palette_bits = ppu_read(attribute_adress);
-
-        // variables to help determine the quandrant and to render the pixels
-        pattern_table_low = ppu_read((control.bkg_patter_adr * 0x1000) +
-                                     ppu_read(tile_adr) * 16 + fine_y);
-        pattern_table_high = ppu_read((control.bkg_patter_adr * 0x1000) +
-                                      ppu_read(tile_adr) * 16 + 8 + fine_y);
-
-        int x_check = coarse_x % 4;
-        int y_check = coarse_y % 4;
-
-        // steps to determine wich palette bits we need from the attribute
-        // table so it determines which quadrant we get the palette from
-        if ((x_check == 0 || x_check == 1) && (y_check == 0 || y_check == 1)) {
-          // Top left quadrant
-          palette_bits &= 0b00000011;
-        } else if ((x_check == 0 || x_check == 1) &&
-                   (y_check == 2 || y_check == 3)) {
-          // Bottom left quadrant
-          palette_bits &= 0b00110000;
-          palette_bits = palette_bits >> 4;
-        } else if ((y_check == 0 || y_check == 1) &&
-                   (x_check == 2 || x_check == 3)) {
-          // Top right quadrant
-          palette_bits &= 0b00001100;
-          palette_bits = palette_bits >> 2;
-        } else {
-          // Bottom right quadrant
-          palette_bits &= 0b11000000;
-          palette_bits = palette_bits >> 6;
-        }
-      }
+    if (oam[sprite_idx] <= curr_render_y &&
+        curr_render_y <= 7 + oam[sprite_idx]  && secondary_oam.size() < 8) {
+      secondary_oam.push(sprite_idx);
+    } else if (0 <= curr_render_y - oam[sprite_idx] &&
+               curr_render_y - oam[sprite_idx] <= 7 &&
+               secondary_oam.size() >= 8) {
+      status.sprite_overflow = true;
+    }
+  }
 
-      uint8_t bkg_pixel = (((pattern_table_high & 0x80) >> 7) << 1) |
-                          ((pattern_table_low & 0x80) >> 7);
+  // without video output the background is only needed for the sprite 0 hit
+  if ((dot - 1) % 8 == 0 && (video_output || sprite0_on_line())) {
+
+    // we need to actually render the things
+    // increment cycle clock by 2 after each fetching
+    // render the thing
+    // These are the addresses that must be read from the nametable or
+    // attribute table to get the necessary info
+    tile_adr = 0x2000 | (v & 0x0FFF);
+    attribute_adress =
+        0x23C0 | (v & 0x0C00) | ((v >> 4) & 0x38) | ((v >> 2) & 0x07);
+
+    // can be reduced to 4 reads like the "real" NES, but this is fine too
+    // memmory accesses by the ppu to get information to render (8 cycles
+    // total)
+    // variables to help determine the quandrant and to render the pixels
+    std::memcpy(bkg_pixels,
+                tile_row((control.bkg_patter_adr * 0x1000) +
+                             ppu_read(tile_adr) * 16 + fine_y,
+                         false),
+                8);
+  }
 
-      while (sprite_shift.size() > 0 &&
-             sprite_shift.front().sprite_x == cycle - 1) {
-        render_sprites.emplace_back(sprite_shift.front());
-        sprite_shift.pop();
-      }
+  if ((dot - 1) % 8 == 0 && video_output) {
+    palette_bits = ppu_read(attribute_adress);
+
+    int x_check = coarse_x % 4;
+    int y_check = coarse_y % 4;
+
+    // steps to determine wich palette bits we need from the attribute
+    // table so it determines which quadrant we get the palette from
+    if ((x_check == 0 || x_check == 1) && (y_check == 0 || y_check == 1)) {
+      // Top left quadrant
+      palette_bits &= 0b00000011;
+    } else if ((x_check == 0 || x_check == 1) &&
+               (y_check == 2 || y_check == 3)) {
+      // Bottom left quadrant
+      palette_bits &= 0b00110000;
+      palette_bits = palette_bits >> 4;
+    } else if ((y_check == 0 || y_check == 1) &&
+               (x_check == 2 || x_check == 3)) {
+      // Top right quadrant
+      palette_bits &= 0b00001100;
+      palette_bits = palette_bits >> 2;
+    } else {
+      // Bottom right quadrant
+      palette_bits &= 0b11000000;
+      palette_bits = palette_bits >> 6;
+    }
+  }
 
-      // rendering the pixels for the current scanline
-      if (mask.bkg_rendering) {
-        sprScreen->SetPixel(cycle - 1, curr_render_y,
-                            get_palette_color(bkg_pixel, palette_bits));
-      } else {
-        sprScreen->SetPixel(cycle - 1, curr_render_y, get_palette_color(0, 0));
-      }
-      pattern_table_high <<= 1;
-      pattern_table_low <<= 1;
-
-      if (render_sprites.size() > 0 && mask.sprite_rendering) {
-        Sprite *render_sprite = &render_sprites.front();
-        for (auto &c_sprite : render_sprites) {
-          render_sprite =
-              c_sprite.idx < render_sprite->idx ? &c_sprite : render_sprite;
-        }
+  uint8_t bkg_pixel = bkg_pixels[(dot - 1) & 0x07];
 
-        for (auto &c_sprite : render_sprites) {
-          if (&c_sprite != render_sprite) {
-            move_sprite_pixels(c_sprite);
-          }
-        }
+  // rendering the pixels for the current scanline
+  if (video_output) {
+    if (dot == 1)
+      frame_emphasis[curr_render_y] = mask.reg >> 5;
+    if (mask.bkg_rendering) {
+      put_pixel(dot - 1, curr_render_y,
+                palette_index(bkg_pixel, palette_bits));
+    } else {
+      put_pixel(dot - 1, curr_render_y, palette_index(0, 0));
+    }
+  }
 
-        bool flip_horz = render_sprite->flip_horz;
-        uint8_t pixel{0x00};
-        if (flip_horz && !render_sprite->priority) {
-          pixel = ((render_sprite->sprite_high & 0x01) << 1) |
-                  (render_sprite->sprite_low & 0x01);
-        } else if (!render_sprite->priority) {
-          pixel = (((render_sprite->sprite_high & 0x80) >> 7) << 1) |
-                  ((render_sprite->sprite_low & 0x80) >> 7);
-        }
+  // a sprite is drawn once its x counter has run out, for 8 dots. When
+  // sprites overlap the one that comes first in OAM is drawn
+  Sprite *render_sprite = nullptr;
+  for (uint8_t i = 0; i < sprite_count; i++) {
+    Sprite &sprite = sprites[i];
+    if (sprite.x_counter == 0 && sprite.pixels_left > 0 &&
+        (!render_sprite || sprite.idx < render_sprite->idx))
+      render_sprite = &sprite;
+  }
 
-        if (pixel != 0) {
-          sprScreen->SetPixel(cycle - 1, curr_render_y,
-                              get_palette_color(pixel, render_sprite->palette));
-        }
-        move_sprite_pixels(*render_sprite);
+  // the sprites that aren't sprite 0 only matter for the picture, they
+  // are dropped at the end of the line anyway
+  if (render_sprite && mask.sprite_rendering &&
+      (video_output || sprite0_on_line())) {
+    uint8_t pixel{0x00};
+    if (!render_sprite->priority)
+      pixel = render_sprite->pixels[render_sprite->shifted];
+
+    if (pixel != 0 && video_output) {
+      put_pixel(dot - 1, curr_render_y,
+                palette_index(pixel, render_sprite->palette));
+    }
 
-        // sprite 0 hit detection
-        if (check_sprite0_hit(*render_sprite, cycle - 1, bkg_pixel, pixel))
-          status.sprite_0_hit = 1;
-      }
+    // sprite 0 hit detection
+    if (check_sprite0_hit(*render_sprite, dot - 1, bkg_pixel, pixel))
+      status.sprite_0_hit = 1;
 
-      while (render_sprites.size() > 0 &&
-             cycle - 1 >= render_sprites.front().sprite_x + 7) {
-        render_sprites.pop_front();
-      }
+    // the sprites that are being drawn all move on to their next pixel
+    for (uint8_t i = 0; i < sprite_count; i++)
+      if (sprites[i].x_counter == 0 && sprites[i].pixels_left > 0)
+        sprites[i].shifted++;
+  }
 
-      if (mask.bkg_rendering || mask.sprite_rendering) {
-        fine_x++;
-        update_render();
-      }
+  for (uint8_t i = 0; i < sprite_count; i++) {
+    if (sprites[i].x_counter > 0)
+      sprites[i].x_counter--;
+    else if (sprites[i].pixels_left > 0)
+      sprites[i].pixels_left--;
+  }
+
+  if (mask.bkg_rendering || mask.sprite_rendering) {
+    fine_x++;
+    update_render();
+  }
+}
+
+// cycles are the horizontal rendering
+// scanlines vertical (somewhat like rows)
+bool Ppu::clock() {
+  /* Returning 1 indicates that an NMI was triggered
+   * This function handles all the rendering done by the PPU
+   * It renders 8 pixels on a scanline all at once and uses buffer cycles to
+   * keep the timing fine.
+   */
+
+  bool return_val = 0;
+
+  if (scanline >= 0 && scanline <= 239) {
+    uint8_t curr_render_y = scanline;
+
+    if (cycle >= 1 && cycle <= 256) {
+      if (cycle == 1)
+        next_dot = 1;
+      // in scanline mode the dots are only rendered once something needs
+      // them, usually at the end of the line
+      if (render_mode == RenderMode::DOT)
+        render_dot(next_dot++);
 
       cycle++;
       total_cycles += 1;
     } else if (cycle >= 257 && cycle <= 320) {
       if (cycle == 257) {
-        clear_sprite_shift();
-        sort_secondary_oam();
-        render_sprites.clear();
+        catch_up();
+        sprite_count = 0;
         // update coarse_x
         if (mask.bkg_rendering || mask.sprite_rendering) {
           v &= (0xFBE0);
@@ -561,18 +635,19 @@ bool Ppu::clock() {
           sprite.sprite_y = 7 - sprite.sprite_y;
         }
 
-        sprite.sprite_low =
-            ppu_read((control.spr_patter_adr * 0x1000) +
-                     oam[sprite.idx + 1] * 16 + sprite.sprite_y);
-        sprite.sprite_high =
-            ppu_read((control.spr_patter_adr * 0x1000) +
-                     oam[sprite.idx + 1] * 16 + sprite.sprite_y + 8);
-
         sprite.palette = (oam[sprite.idx + 2] & 0x03) + 4;
         sprite.flip_horz = (oam[sprite.idx + 2] & 0x40) >> 6;
         sprite.priority = (oam[sprite.idx + 2] & 0x80) >> 7;
 
-        sprite_shift.push(std::move(sprite));
+        std::memcpy(sprite.pixels,
+                    tile_row((control.spr_patter_adr * 0x1000) +
+                                 oam[sprite.idx + 1] * 16 + sprite.sprite_y,
+                             sprite.flip_horz),
+                    8);
+
+        sprite.x_counter = sprite.sprite_x;
+        sprite.pixels_left = 8;
+        sprites[sprite_count++] = sprite;
         secondary_oam.pop();
       }
 
@@ -1,13 +1,10 @@
 #ifndef PPU_H
 #define PPU_H
 #include "cartridge.h"
-#include "olcPixelGameEngine.h"
+#include <algorithm>
 #include <cstdint>
-#include <fstream>
 #include <map>
 #include <memory>
-#include <queue>
-#include <unordered_set>
 #include <vector>
 
 class Bus;
@@ -16,78 +13,60 @@ struct Sprite {
   uint8_t idx{0x00};
   uint8_t sprite_y{0x00};
   uint8_t sprite_x{0x00};
-  uint8_t sprite_low{0x00};
-  uint8_t sprite_high{0x00};
+  // the row of the sprite on this scanline, already flipped, and how many of
+  // its pixels have gone by
+  uint8_t pixels[8]{};
+  uint8_t shifted{0x00};
+  // dots left before the sprite starts, then pixels left to draw
+  uint8_t x_counter{0x00};
+  uint8_t pixels_left{0x00};
   uint8_t palette{0x00};
   uint8_t flip_horz{0x00};
   uint8_t priority{0x00};
 };
 
 
-class Ppu {
-public:
-  Ppu();
-  ~Ppu();
+// DOT renders each pixel on its own dot. SCANLINE renders the visible
+// pixels of a line in one go at the end of the line, or earlier if the CPU
+// touches the PPU in the middle of it. Both give the same picture
+enum class RenderMode : uint8_t { DOT, SCANLINE };
 
-  // PPU will also be able to communicate with the CPU, so it can write and read
-  // on the CPU soo we will need these functions
-  uint8_t cpu_read(uint16_t adr, bool read = false);
-  void cpu_write(uint16_t adr, uint8_t val);
+// queue that keeps its elements inline so the PPU state can be copied as
+// a whole. It holds at most N elements between two clears
+template <typename T, uint8_t N> struct InlineQueue {
+  T items[N];
+  uint8_t head{0};
+  uint8_t tail{0};
 
-  // of course, the PPU will also need to write and read on its own
-  // addressable range
-  uint8_t ppu_read(uint16_t adr, bool read = false);
-  void ppu_write(uint16_t adr, uint8_t val);
+  void push(const T &item) {
+    if (tail < N)
+      items[tail++] = item;
+  }
+  void pop() { head++; }
+  T &front() { return items[head]; }
+  uint8_t size() const { return tail - head; }
+  void clear() { head = tail = 0; }
+  T *begin() { return items + head; }
+  T *end() { return items + tail; }
+};
 
-private:
-  // PPU also has acces to the cartridge, so we will keep a reference to it
-  // it does not own it though, so it has a raw pointer
-  // TEMP: LOGGING FOR DEBUG
-  std::ofstream ofs{"ppu_pattern.txt"};
-  Cartridge *card;
-  uint8_t ntables[2][1024]; // vram memory for the nametables 0x2000 to 0x2FFF
+// Everything the PPU needs to pick up where it left off, kept in one plain
+// struct so save states can copy it in one go
+struct PpuState {
+protected:
+  uint8_t ntables[2][1024]{}; // vram memory for the nametables 0x2000 to 0x2FFF
   // even though there are 64 color palettes,
   // the palette color only stores an index to which
   // index color we will point to. Size of 32 since
   // that's the size of 0x3f00 to 0x3f1f
-  uint8_t palettes[32];
+  uint8_t palettes[32]{};
   // the size of the pattern
   // memory must be 4096 because
   // the tables are 16 x 16 and
   // the tiles are composed of 2 8 byte
   // planes for the low and the high bytes
-  uint8_t npatterns[2][4096];
-
-  // Graphics for PPU
-  // Array NES can display
-  olc::Pixel palScreen[0x40];
-  // FullScreen Output
-  std::unique_ptr<olc::Sprite> sprScreen;
-  // Name table display
-  // tells the PPU how to place the tiles from the pattern table
-  std::vector<std::unique_ptr<olc::Sprite>> sprNameTable;
-  // Pattern display
-  // pattern table is divided into 2 parts of memory
-  // first from 0000-0FFFF and second from 1000-1FFF
-  // both patterns have 256 tiles (16x16)
-  // EACH tile is 8x8 (kind of like a grid)
-  // 01000001
-  // 11000010
-  //  01000100
-  // 01001000
-  // 00010000
-  // 00100000
-  // 01000000
-  // 10000000
-  // the 8x8 grid is seperated into the low and the high bit
-  // So the table above could be the low or the high bit thable for a tile
-  // and each row is stored as a byte
-  // so the first row could be stored as 0x41
-  // makes it easy to figure out what is what
-  std::vector<std::unique_ptr<olc::Sprite>> sprPatternTable;
+  uint8_t npatterns[2][4096]{};
 
-  // for later
-  // TODO: remove this, only for debugging (the public thing btw)
 public:
   int16_t scanline = 0;
   int16_t cycle = 0;
@@ -99,9 +78,8 @@ public:
   // attribute_adress is the adress needing to be read from the attribute table
   // to get the palette of a tile
   uint16_t attribute_adress = 0x0000;
-  // index pointing to the tile from the pattern table
-  uint8_t pattern_table_low = 0x00;
-  uint8_t pattern_table_high = 0x00;
+  // pixels of the background tile being drawn, from the tile cache
+  uint8_t bkg_pixels[8]{};
   // palette value where bit 0-1 are the palettes for top left
   // the bits 2-3 are the paletters for top right
   // 4-5 for bottom left and 6-7 for bottom right
@@ -155,7 +133,7 @@ public:
       uint8_t master_select : 1;
       uint8_t nmi : 1;
     };
-  } control;
+  } control{};
 
   union PPUMASK {
     uint8_t reg;
@@ -169,7 +147,7 @@ public:
       uint8_t green : 1;
       uint8_t blue : 1;
     };
-  } mask;
+  } mask{};
 
   union PPUSTATUS {
     uint8_t reg;
@@ -183,86 +161,155 @@ public:
       uint8_t sprite_0_hit : 1;
       uint8_t vblank : 1;
     };
-  } status;
+  } status{};
 
-  uint8_t oam_addr;
-  uint8_t oam_data;
+  uint8_t oam_addr = 0x00;
+  uint8_t oam_data = 0x00;
 
   // Where most sprite information is stored
-  std::vector<uint8_t> oam;
+  uint8_t oam[256]{};
 
   // Sprites that are about to be loaded in the next scanline are stored in the
   // secondary OAM Overflow flag in PPUSTATUS if something bad happens
   // saves x positioning to easily render the sprite
-  using pair = std::pair<uint8_t, uint8_t>;
-  std::queue<uint8_t> secondary_oam;
+  InlineQueue<uint8_t, 8> secondary_oam;
 
-  // Hold a pair of <low, high> addresses for tiles
-  std::queue<Sprite> sprite_shift;
-  // helper map to find priority of rendering sprites
-  // bool indicating if the PPU is currently rendering a sprite
-  // int indicating how many pixels (in horz direction) of the sprite have been
-  // rendered current sprite being rendered
-  std::deque<Sprite> render_sprites;
-  std::queue<pair> render_bkg;
+  // the sprites of the scanline, loaded at the end of the previous one
+  Sprite sprites[8]{};
+  uint8_t sprite_count = 0;
 
-  void store_current_bkg_pal(uint8_t coarse_x, uint8_t coarse_y, uint8_t fine_y);
-  bool check_sprite0_hit(Sprite &sprite, uint8_t x_rendering_pos, uint8_t bkg_pixel, uint8_t sprite_pixel);
+  // next visible dot of the current scanline that has not been rendered
+  int16_t next_dot = 1;
+  bool frame_complete = false;
+};
 
-  void sort_secondary_oam() {
-    // sort by sprites by their x position
-    std::vector<uint8_t> temp(secondary_oam.size());
-    for (size_t i = 0; i < temp.size(); i++) {
-      temp[i] = secondary_oam.front();
-      secondary_oam.pop();
-    }
-    std::vector<uint8_t> &r = oam;
-    std::sort(temp.begin(), temp.end(), [&r](const auto &a, const auto &b) {
-      return r[a + 3] < r[b + 3];
-    });
-    for (size_t i = 0; i < temp.size(); i++) {
-      secondary_oam.push(temp[i]);
-    }
-  }
+class Ppu : public PpuState {
+public:
+  Ppu();
+  ~Ppu();
 
-  void move_sprite_pixels(Sprite &sprite) {
-    bool flip_horz = oam[sprite.idx + 2] & 0x40;
-    if (flip_horz) {
-      sprite.sprite_low >>= 1;
-      sprite.sprite_high >>= 1;
-    } else {
-      sprite.sprite_low <<= 1;
-      sprite.sprite_high <<= 1;
-    }
-  }
+  // PPU will also be able to communicate with the CPU, so it can write and read
+  // on the CPU soo we will need these functions
+  uint8_t cpu_read(uint16_t adr, bool read = false);
+  void cpu_write(uint16_t adr, uint8_t val);
 
-  void clear_secondary_oam() {
-    std::queue<uint8_t> q;
-    std::swap(q, secondary_oam);
-  }
+  // of course, the PPU will also need to write and read on its own
+  // addressable range
+  uint8_t ppu_read(uint16_t adr, bool read = false);
+  void ppu_write(uint16_t adr, uint8_t val);
 
-  void clear_bkg_shift() {
-    std::queue<pair> q;
-    std::swap(q, render_bkg);
+private:
+  // PPU also has acces to the cartridge, so we will keep a reference to it
+  // it does not own it though, so it has a raw pointer
+  Cartridge *card;
+  // the nametable at 0x2000, 0x2400, 0x2800 and 0x2C00, which depends on the
+  // mirroring of the cartridge
+  uint8_t *nt_page[4]{nullptr};
+  // Graphics for PPU
+  // Array NES can display, as RGBA with red in the lowest byte
+  uint32_t palScreen[0x40];
+  // palScreen for each of the 8 combinations of the color emphasis bits,
+  // indexed by emphasis << 6 | color
+  uint32_t rgb_lut[0x200];
+  // the frame as color indexes into palScreen, only turned into pixels when
+  // the screen is asked for
+  uint8_t frame[256 * 240];
+  // emphasis bits of the mask register for each scanline of the frame
+  uint8_t frame_emphasis[240];
+  // FullScreen Output
+  std::vector<uint32_t> screen;
+  // Pattern display
+  // pattern table is divided into 2 parts of memory
+  // first from 0000-0FFFF and second from 1000-1FFF
+  // both patterns have 256 tiles (16x16)
+  // EACH tile is 8x8 (kind of like a grid)
+  // 01000001
+  // 11000010
+  //  01000100
+  // 01001000
+  // 00010000
+  // 00100000
+  // 01000000
+  // 10000000
+  // the 8x8 grid is seperated into the low and the high bit
+  // So the table above could be the low or the high bit thable for a tile
+  // and each row is stored as a byte
+  // so the first row could be stored as 0x41
+  // makes it easy to figure out what is what
+  std::vector<uint32_t> pattern_tables[2];
+
+  // the pattern memory decoded to one byte (0 to 3) per pixel, as it is and
+  // flipped horizontally, in pages of 1KB (64 tiles). tile_src is the memory
+  // each page was decoded from, the page is decoded again when the mapper
+  // points somewhere else or when it's set to nullptr after a write
+  uint8_t tile_pixels[2][8][64 * 8 * 8];
+  const uint8_t *tile_src[8]{nullptr};
+  void decode_tiles(uint8_t page, const uint8_t *src);
+
+public:
+  // renders a single visible dot (1 to 256) of the current scanline
+  void render_dot(int16_t dot);
+
+  void store_current_bkg_pal(uint8_t coarse_x, uint8_t coarse_y, uint8_t fine_y);
+  // color index of a pixel in the given palette, same as reading it through
+  // ppu_read(0x3F00 + ...) but without going through the cartridge
+  uint8_t palette_index(uint8_t pixel, uint8_t palette) const {
+    uint8_t adr = ((palette << 2) + pixel) & 0x1F;
+    // 0x3F10, 0x3F14, 0x3F18 and 0x3F1C mirror the background ones
+    if ((adr & 0x13) == 0x10)
+      adr &= 0x0F;
+    if ((mask.sprite_rendering && mask.bkg_rendering) && (adr & 0x03) == 0)
+      adr = 0x00; // Redirect to universal background color
+    return palettes[adr] & 0x3F;
+  }
+  void put_pixel(uint8_t x, uint8_t y, uint8_t color) {
+    // greyscale only keeps the column of grey colors
+    frame[y * 256 + x] = mask.grey_scale ? color & 0x30 : color;
   }
+  bool check_sprite0_hit(Sprite &sprite, uint8_t x_rendering_pos, uint8_t bkg_pixel, uint8_t sprite_pixel);
 
-  void clear_sprite_shift() {
-    std::queue<Sprite> q;
-    std::swap(q, sprite_shift);
+  // true if sprite 0 is still to be drawn on the current scanline
+  bool sprite0_on_line() const {
+    for (uint8_t i = 0; i < sprite_count; i++)
+      if (sprites[i].idx == 0 && sprites[i].pixels_left > 0)
+        return true;
+    return false;
   }
 
+  void clear_secondary_oam() { secondary_oam.clear(); }
+
 public:
   // public interface
   void connectCard(Cartridge *c);
+  // points the nametables to the right memory, needs to be called whenever
+  // the mapper changes the mirroring
+  void map_nametables();
+  // the 8 pixels of a row of a tile, adr is the address of its low byte in
+  // the pattern memory
+  const uint8_t *tile_row(uint16_t adr, bool flip);
+  // needs to be called when the pattern memory was changed without going
+  // through ppu_write, like when a state is loaded
+  void invalidate_tiles();
   bool clock();
   void update_render();
+  // renders the dots of the current scanline that were put off in scanline
+  // mode, up to the current cycle. Needs to be called before anything that
+  // changes or looks at the rendering state from outside of the PPU
+  void catch_up();
+  RenderMode render_mode{RenderMode::DOT};
+  // when false nothing is drawn, the PPU only does what the CPU can notice
+  // (registers, timing and the sprite 0 hit). Used for frames that are
+  // emulated but never shown
+  bool video_output{true};
 
   // debugging functions
-  olc::Pixel get_palette_color(uint8_t pixel, uint8_t palette);
-  olc::Sprite *getScreen() const;
-  olc::Sprite &getNameTable(uint8_t i);
-  olc::Sprite &getpatternTable(uint8_t i, uint8_t palette);
-  bool frame_complete;
+  // the images are 256x240 (screen) and 128x128 (pattern tables) RGBA
+  // pixels with red in the lowest byte, the same layout as olc::Pixel
+  uint32_t get_palette_color(uint8_t pixel, uint8_t palette);
+  const uint32_t *getScreen();
+  // the current frame as color indexes, 256 per scanline
+  const uint8_t *get_frame() const { return frame; }
+  const uint32_t *getpatternTable(uint8_t i, uint8_t palette);
 };
 
 // Cpu configures the mapper
@@ -0,0 +1,95 @@
+#include "ppu_thread.h"
+#include "ppu.h"
+#include <algorithm>
+#include <cstdint>
+
+// dots in a frame, every scanline has 341 of them
+#define FRAME_DOTS (262 * 341)
+// where the PPU is when it raises the NMI and when it completes a frame
+#define NMI_POSITION (241 * 341 + 1)
+#define FRAME_END_POSITION (261 * 341 + 340)
+
+PpuThread::PpuThread(Ppu &ppu, uint64_t dot) : ppu{ppu} {
+  rebase(dot);
+  thread = std::thread{&PpuThread::run, this};
+}
+
+PpuThread::~PpuThread() {
+  stopping.store(true, std::memory_order_relaxed);
+  request.fetch_add(1, std::memory_order_release);
+  request.notify_one();
+  thread.join();
+}
+
+void PpuThread::publish(uint64_t dot) {
+  published = dot;
+  running = true;
+  target.store(dot, std::memory_order_relaxed);
+  shared_tail.store(tail, std::memory_order_relaxed);
+  request.fetch_add(1, std::memory_order_release);
+  request.notify_one();
+}
+
+void PpuThread::sync(uint64_t dot) {
+  publish(dot);
+  uint32_t wanted = request.load(std::memory_order_relaxed);
+  uint32_t seen;
+  while ((seen = done.load(std::memory_order_acquire)) != wanted)
+    done.wait(seen, std::memory_order_acquire);
+  running = false;
+
+  if (nmi_raised) {
+    nmi_raised = false;
+    nmi = true;
+  }
+  find_next_event();
+}
+
+void PpuThread::rebase(uint64_t dot) {
+  dots = dot;
+  published = dot;
+  nmi = nmi_raised = false;
+  find_next_event();
+}
+
+void PpuThread::find_next_event() {
+  // the PPU goes through the same dots every frame, so the next NMI and end
+  // of frame are a fixed number of dots away from where it is
+  int position = ppu.scanline * 341 + ppu.cycle;
+  int to_nmi = (NMI_POSITION - position + FRAME_DOTS) % FRAME_DOTS;
+  int to_end = (FRAME_END_POSITION - position + FRAME_DOTS) % FRAME_DOTS;
+  next_event = dots + std::min(to_nmi, to_end);
+}
+
+void PpuThread::run() {
+  uint32_t seen = 0;
+  while (true) {
+    request.wait(seen, std::memory_order_acquire);
+    seen = request.load(std::memory_order_acquire);
+    if (stopping.load(std::memory_order_relaxed))
+      return;
+
+    uint64_t until = target.load(std::memory_order_relaxed);
+    size_t end = shared_tail.load(std::memory_order_relaxed);
+    size_t next = head.load(std::memory_order_relaxed);
+    while (true) {
+      // the writes happen before the dot they were made at
+      while (next != end && queue[next % PPU_QUEUE_SIZE].dot == dots) {
+        const Write &w = queue[next % PPU_QUEUE_SIZE];
+        ppu.cpu_write(w.adr, w.val);
+        next++;
+      }
+      if (dots == until)
+        break;
+      if (ppu.clock()) {
+        nmi_dot = dots;
+        nmi_raised = true;
+      }
+      dots++;
+    }
+    head.store(next, std::memory_order_release);
+
+    done.store(seen, std::memory_order_release);
+    done.notify_one();
+  }
+}
@@ -0,0 +1,105 @@
+#ifndef PPU_THREAD_H
+#define PPU_THREAD_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <thread>
+
+class Ppu;
+
+// register writes the CPU can get ahead of the PPU by, a power of 2
+#define PPU_QUEUE_SIZE 4096
+// the CPU lets the PPU thread go on every scanline's worth of dots
+#define PPU_PUBLISH_DOTS 341
+
+// runs the PPU on a thread of its own, behind the CPU. The CPU only logs the
+// register writes with the dot they happen at and the PPU thread applies
+// them when it gets there, so both sides see the same thing they would when
+// running on a single thread. The CPU has to wait for the PPU (sync) when it
+// reads a PPU register, touches the mapper or the OAM, and at the dots the
+// PPU raises the NMI or completes a frame, which are known in advance.
+// Every function is meant to be called by the thread running the CPU, the
+// PPU can only be looked at from it while the PPU thread is idle
+class PpuThread {
+public:
+  // dot is the number of dots the PPU has already run
+  PpuThread(Ppu &ppu, uint64_t dot);
+  ~PpuThread();
+
+  // a write to PPU register adr (0 to 7) before the PPU runs dot
+  void write(uint64_t dot, uint8_t adr, uint8_t val) {
+    if (tail - head.load(std::memory_order_acquire) == PPU_QUEUE_SIZE)
+      sync(dot);
+    queue[tail % PPU_QUEUE_SIZE] = Write{dot, adr, val};
+    tail++;
+  }
+  // lets the PPU run up to dot, waiting for it if it raised the NMI or
+  // completed a frame on the way
+  void run_to(uint64_t dot) {
+    if (dot > next_event)
+      sync(dot);
+    else if (dot - published >= PPU_PUBLISH_DOTS)
+      publish(dot);
+  }
+  // waits for the PPU to have run up to dot with every write before it
+  // applied
+  void sync(uint64_t dot);
+  // true if the PPU raised the NMI since the last call, dot is the dot it
+  // did it on
+  bool take_nmi(uint64_t &dot) {
+    if (!nmi)
+      return false;
+    nmi = false;
+    dot = nmi_dot;
+    return true;
+  }
+  // true if the PPU thread is waiting for the CPU, the PPU can then be
+  // looked at and changed
+  bool idle() const { return !running; }
+  // the PPU was changed to be at dot, needs to be synced
+  void rebase(uint64_t dot);
+
+private:
+  struct Write {
+    uint64_t dot;
+    uint8_t adr;
+    uint8_t val;
+  };
+
+  Ppu &ppu;
+  std::thread thread;
+
+  Write queue[PPU_QUEUE_SIZE];
+  // head is only moved by the PPU thread, tail only by the CPU. The PPU
+  // thread only sees the writes up to shared_tail
+  std::atomic<size_t> head{0};
+  size_t tail{0};
+  std::atomic<size_t> shared_tail{0};
+
+  // the CPU asks the PPU to run up to target by bumping request, the PPU
+  // thread sets done to the request it has finished
+  std::atomic<uint64_t> target{0};
+  std::atomic<uint32_t> request{0};
+  std::atomic<uint32_t> done{0};
+  std::atomic<bool> stopping{false};
+
+  // CPU side
+  uint64_t published{0};
+  // last dot before the next NMI or end of frame
+  uint64_t next_event{0};
+  bool running{false};
+  bool nmi{false};
+
+  // PPU side, only read by the CPU after a sync
+  uint64_t dots{0};
+  uint64_t nmi_dot{0};
+  bool nmi_raised{false};
+
+  void publish(uint64_t dot);
+  // finds next_event from where the PPU is
+  void find_next_event();
+  void run();
+};
+
+#endif
@@ -0,0 +1,135 @@
+#include "rewind.h"
+#include "bus.h"
+#include <cstdint>
+
+// unchanged bytes needed to end a literal, a new record costs 4 bytes
+#define MIN_ZERO_RUN 4
+#define MAX_RUN 0xFFFF
+
+namespace {
+void put16(std::vector<uint8_t> &out, size_t val) {
+  out.push_back(val & 0xFF);
+  out.push_back(val >> 8);
+}
+
+size_t get16(const uint8_t *p) { return p[0] | (p[1] << 8); }
+
+// the delta is a list of records, each one made of the number of unchanged
+// bytes, the number of changed bytes and then the changed bytes XORed with
+// the keyframe
+void encode(const std::vector<uint8_t> &state, const std::vector<uint8_t> &key,
+            std::vector<uint8_t> &out) {
+  out.clear();
+  size_t n = state.size();
+  size_t i = 0;
+  while (i < n) {
+    size_t zeros = 0;
+    while (i < n && zeros < MAX_RUN && state[i] == key[i]) {
+      zeros++;
+      i++;
+    }
+
+    // short runs of unchanged bytes are cheaper to keep in the literal
+    size_t start = i;
+    while (i < n && i - start < MAX_RUN) {
+      if (state[i] == key[i]) {
+        size_t run = 0;
+        while (run < MIN_ZERO_RUN && i + run < n &&
+               state[i + run] == key[i + run])
+          run++;
+        if (run == MIN_ZERO_RUN || i + run == n)
+          break;
+      }
+      i++;
+    }
+
+    put16(out, zeros);
+    put16(out, i - start);
+    for (size_t j = start; j < i; j++)
+      out.push_back(state[j] ^ key[j]);
+  }
+}
+
+void decode(const std::vector<uint8_t> &key, const std::vector<uint8_t> &delta,
+            std::vector<uint8_t> &out) {
+  out = key;
+  size_t i = 0;
+  const uint8_t *p = delta.data();
+  const uint8_t *end = p + delta.size();
+  while (p < end) {
+    i += get16(p);
+    size_t len = get16(p + 2);
+    p += 4;
+    for (size_t j = 0; j < len; j++)
+      out[i++] ^= *p++;
+  }
+}
+} // namespace
+
+Rewind::Rewind(Bus &bus, size_t frames) : bus{bus}, ring(frames) {}
+
+void Rewind::push() {
+  if (ring.empty())
+    return;
+
+  bus.save_state(state);
+  if (count == ring.size())
+    drop_oldest();
+
+  size_t s = slot(count);
+  Entry &entry = ring[s];
+  if (count == 0 || since_key >= KEYFRAME_INTERVAL) {
+    entry.data = state;
+    entry.keyframe = true;
+    key = s;
+    since_key = 0;
+  } else {
+    encode(state, ring[key].data, entry.data);
+    entry.keyframe = false;
+    entry.key = key;
+  }
+  count++;
+  since_key++;
+}
+
+bool Rewind::pop() {
+  if (count == 0)
+    return false;
+
+  Entry &entry = ring[slot(count - 1)];
+  if (entry.keyframe) {
+    bus.load_state(entry.data);
+  } else {
+    decode(ring[entry.key].data, entry.data, state);
+    bus.load_state(state);
+  }
+  count--;
+
+  // the next frames are saved against the keyframe of the new newest frame
+  if (count > 0) {
+    size_t newest = slot(count - 1);
+    key = ring[newest].keyframe ? newest : ring[newest].key;
+    since_key = (newest + ring.size() - key) % ring.size() + 1;
+  }
+  return true;
+}
+
+void Rewind::clear() {
+  first = 0;
+  count = 0;
+}
+
+size_t Rewind::memory_used() const {
+  size_t total = 0;
+  for (size_t i = 0; i < count; i++)
+    total += ring[slot(i)].data.size();
+  return total;
+}
+
+void Rewind::drop_oldest() {
+  // the frames that were saved against the oldest keyframe go with it
+  do {
+    first = slot(1);
+    count--;
+  } while (count > 0 && !ring[first].keyframe);
+}
@@ -0,0 +1,64 @@
+#ifndef REWIND_H
+#define REWIND_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+class Bus;
+
+// one whole state per second of rewind
+#define KEYFRAME_INTERVAL 60
+
+// keeps the save states of the last frames so the game can be played
+// backwards. Every KEYFRAME_INTERVAL frames a whole state is kept, the frames
+// in between only keep what changed since that state, as a run length encoded
+// XOR. Restoring a frame only ever needs its keyframe and its own delta, so
+// stepping back costs the same for every frame
+class Rewind {
+public:
+  // frames is how many frames are kept, 60 per second of rewind
+  Rewind(Bus &bus, size_t frames = 60 * 60);
+
+  // saves the current state of the bus as the newest frame, the oldest
+  // frames are dropped once the ring is full
+  void push();
+  // loads the newest frame into the bus and removes it, returns false if
+  // there is nothing left to rewind to
+  bool pop();
+  void clear();
+
+  // number of frames that can be rewound
+  size_t size() const { return count; }
+  // bytes used by the saved frames
+  size_t memory_used() const;
+
+private:
+  // one frame of the ring. A keyframe keeps the whole state in data,
+  // the others keep the encoded delta against the state of the keyframe in
+  // slot key
+  struct Entry {
+    std::vector<uint8_t> data;
+    size_t key{0};
+    bool keyframe{false};
+  };
+
+  Bus &bus;
+  std::vector<Entry> ring;
+  // slot of the oldest frame and number of frames kept
+  size_t first{0};
+  size_t count{0};
+  // slot of the keyframe the next delta is taken against, and how many
+  // frames were saved since it
+  size_t key{0};
+  size_t since_key{0};
+
+  // scratch buffer for the state being saved or loaded, so nothing is
+  // allocated once the ring has filled up
+  std::vector<uint8_t> state;
+
+  size_t slot(size_t i) const { return (first + i) % ring.size(); }
+  void drop_oldest();
+};
+
+#endif
@@ -0,0 +1,148 @@
+#include "rom.h"
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#define PRG_SIZE 16 * 1024
+#define CHR_SIZE 8 * 1024
+#define TRAINER_SIZE 512
+
+static_assert(sizeof(sHeader) == 16);
+
+#ifdef _WIN32
+MappedFile::MappedFile(const std::string &file) {
+  HANDLE handle = CreateFileA(file.c_str(), GENERIC_READ, FILE_SHARE_READ,
+                              nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL,
+                              nullptr);
+  if (handle == INVALID_HANDLE_VALUE)
+    throw std::runtime_error("File does not exist.\n");
+
+  LARGE_INTEGER size;
+  if (!GetFileSizeEx(handle, &size) || size.QuadPart == 0) {
+    CloseHandle(handle);
+    throw std::runtime_error("File format is not ines\n");
+  }
+  length = size.QuadPart;
+
+  // the mapping keeps the file open, the handle isn't needed anymore
+  mapping = CreateFileMappingA(handle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+  CloseHandle(handle);
+  if (!mapping)
+    throw std::runtime_error("Could not map the file\n");
+  ptr = static_cast<const uint8_t *>(
+      MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+  if (!ptr) {
+    CloseHandle(mapping);
+    throw std::runtime_error("Could not map the file\n");
+  }
+}
+
+MappedFile::~MappedFile() {
+  UnmapViewOfFile(ptr);
+  CloseHandle(mapping);
+}
+#else
+MappedFile::MappedFile(const std::string &file) {
+  int fd = open(file.c_str(), O_RDONLY);
+  if (fd < 0)
+    throw std::runtime_error("File does not exist.\n");
+
+  struct stat st;
+  if (fstat(fd, &st) != 0 || st.st_size == 0) {
+    close(fd);
+    throw std::runtime_error("File format is not ines\n");
+  }
+  length = st.st_size;
+
+  // the mapping stays valid once the file is closed
+  void *p = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (p == MAP_FAILED)
+    throw std::runtime_error("Could not map the file\n");
+  ptr = static_cast<const uint8_t *>(p);
+}
+
+MappedFile::~MappedFile() { munmap(const_cast<uint8_t *>(ptr), length); }
+#endif
+
+RomImage::RomImage(const std::string &path) : file{path} {
+  if (file.size() < sizeof(header))
+    throw std::runtime_error("File format is not ines\n");
+  std::memcpy(&header, file.data(), sizeof(header));
+
+  if (std::memcmp(header.name, "NES\x1A", 4) != 0)
+    throw std::runtime_error("File format is not ines\n");
+
+  // old tools (DiskDude! and the like) wrote their name over the end of the
+  // header, byte 7 and the upper mapper bits are garbage then. NES 2.0
+  // headers have 0b10 in bits 2-3 of byte 7, iNES ones end with zeros
+  const uint8_t *bytes = file.data();
+  bool nes2 = (header.mapper2 & 0x0C) == 0x08;
+  bool padded = (header.mapper2 & 0x0C) == 0x00 &&
+                (bytes[12] | bytes[13] | bytes[14] | bytes[15]) == 0;
+  if (!nes2 && !padded)
+    header.mapper2 = 0x00;
+
+  size_t offset = sizeof(header);
+  if (header.mapper1 & 0x04)
+    offset += TRAINER_SIZE;
+
+  size_t prg_size = header.prg_rom_chunks * PRG_SIZE;
+  size_t chr_size = header.chr_rom_chunks * CHR_SIZE;
+  if (file.size() < offset + prg_size + chr_size)
+    throw std::runtime_error("File is smaller than its header says\n");
+
+  prg = {file.data() + offset, prg_size};
+  chr = {file.data() + offset + prg_size, chr_size};
+}
+
+namespace {
+// FNV-1a of the PRG and CHR ROM
+uint64_t content_hash(const RomImage &rom) {
+  uint64_t hash = 1469598103934665603ull;
+  for (std::span<const uint8_t> data : {rom.prg, rom.chr})
+    for (uint8_t byte : data) {
+      hash ^= byte;
+      hash *= 1099511628211ull;
+    }
+  return hash;
+}
+
+bool same_content(const RomImage &a, const RomImage &b) {
+  return std::ranges::equal(a.prg, b.prg) && std::ranges::equal(a.chr, b.chr) &&
+         a.header.mapper1 == b.header.mapper1 &&
+         a.header.mapper2 == b.header.mapper2;
+}
+} // namespace
+
+std::shared_ptr<const RomImage> RomCache::load(const std::string &file) {
+  static std::mutex mutex;
+  static std::unordered_map<uint64_t, std::weak_ptr<const RomImage>> images;
+
+  auto rom = std::make_shared<const RomImage>(file);
+  uint64_t hash = content_hash(*rom);
+
+  std::lock_guard<std::mutex> lock{mutex};
+  auto it = images.find(hash);
+  if (it != images.end()) {
+    std::shared_ptr<const RomImage> cached = it->second.lock();
+    if (cached && same_content(*cached, *rom))
+      return cached;
+  }
+  images[hash] = rom;
+  return rom;
+}
@@ -0,0 +1,61 @@
+#ifndef ROM_H
+#define ROM_H
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <span>
+#include <string>
+
+struct sHeader {
+  char name[4];
+  uint8_t prg_rom_chunks;
+  uint8_t chr_rom_chunks;
+  uint8_t mapper1;
+  uint8_t mapper2;
+  uint8_t prg_ram_size;
+  uint8_t tv_system1;
+  uint8_t tv_system2;
+  char unused[5];
+};
+
+// a file mapped read only into memory, it stays mapped as long as this lives
+class MappedFile {
+public:
+  MappedFile(const std::string &file);
+  ~MappedFile();
+  MappedFile(const MappedFile &) = delete;
+  MappedFile &operator=(const MappedFile &) = delete;
+
+  const uint8_t *data() const { return ptr; }
+  size_t size() const { return length; }
+
+private:
+  const uint8_t *ptr{nullptr};
+  size_t length{0};
+#ifdef _WIN32
+  void *mapping{nullptr};
+#endif
+};
+
+// an iNES file. It never changes once it's loaded, so all the cartridges of
+// the same game share a single one. PRG and CHR point straight into the
+// mapped file
+struct RomImage {
+  // throws if the file can't be opened or isn't a valid iNES file
+  RomImage(const std::string &file);
+
+  MappedFile file;
+  sHeader header;
+  std::span<const uint8_t> prg;
+  std::span<const uint8_t> chr;
+};
+
+// hands out the ROM images, a game that is already loaded by another
+// cartridge isn't kept twice. Images are freed once no cartridge uses them
+class RomCache {
+public:
+  static std::shared_ptr<const RomImage> load(const std::string &file);
+};
+
+#endif
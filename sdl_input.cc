@@ -0,0 +1,94 @@
+#include <SDL2/SDL.h>
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+
+#include "sdl_input.h"
+
+namespace {
+// how often the joystick is read
+constexpr auto POLL_INTERVAL = std::chrono::milliseconds(2);
+
+uint8_t read_joystick(SDL_Joystick *joystick) {
+  Controller::Input input{0x00};
+
+  for (int i = 0; i < SDL_JoystickNumButtons(joystick); i++) {
+    uint8_t state = SDL_JoystickGetButton(joystick, i);
+    switch (i) {
+    case 0:
+      input.a_button = state;
+      break;
+    case 1:
+      input.b_button = state;
+      break;
+    case 4:
+      input.select = state;
+      break;
+    case 6:
+      input.start = state;
+      break;
+    case 11:
+      input.up = state;
+      break;
+    case 12:
+      input.down = state;
+      break;
+    case 13:
+      input.left = state;
+      break;
+    case 14:
+      input.right = state;
+      break;
+    }
+  }
+  return input.reg;
+}
+} // namespace
+
+SdlInput::SdlInput(Controller &controller)
+    : controller{controller}, thread{&SdlInput::run, this} {}
+
+SdlInput::~SdlInput() {
+  running = false;
+  thread.join();
+}
+
+void SdlInput::set_keyboard(uint8_t buttons) {
+  keyboard = buttons;
+  publish();
+}
+
+void SdlInput::publish() { controller.set_buttons(joystick | keyboard); }
+
+void SdlInput::run() {
+  // there is no SDL window, the joystick has to be read in the background
+  SDL_SetHint(SDL_HINT_JOYSTICK_ALLOW_BACKGROUND_EVENTS, "1");
+  if (SDL_Init(SDL_INIT_JOYSTICK) != 0) {
+    std::cerr << "SDL_Init Error: " << SDL_GetError() << std::endl;
+    return;
+  }
+
+  SDL_Joystick *sdl_joystick = nullptr;
+  while (running) {
+    if (!sdl_joystick) {
+      // the joystick can be plugged in at any time
+      SDL_JoystickUpdate();
+      if (SDL_NumJoysticks() > 0)
+        sdl_joystick = SDL_JoystickOpen(0);
+    } else if (!SDL_JoystickGetAttached(sdl_joystick)) {
+      SDL_JoystickClose(sdl_joystick);
+      sdl_joystick = nullptr;
+      joystick = 0x00;
+      publish();
+    } else {
+      SDL_JoystickUpdate(); // Ensure input is updated
+      joystick = read_joystick(sdl_joystick);
+      publish();
+    }
+    std::this_thread::sleep_for(POLL_INTERVAL);
+  }
+
+  if (sdl_joystick)
+    SDL_JoystickClose(sdl_joystick);
+  SDL_Quit();
+}
@@ -0,0 +1,31 @@
+#ifndef SDL_INPUT_H
+#define SDL_INPUT_H
+
+#include "controller.h"
+#include <atomic>
+#include <cstdint>
+#include <thread>
+
+// Polls the first joystick with SDL on its own thread and publishes the
+// buttons to the controller. SDL is initialized once, when the thread starts
+class SdlInput {
+public:
+  SdlInput(Controller &controller);
+  ~SdlInput();
+
+  // buttons the front end read from the keyboard, they are merged with the
+  // ones from the joystick
+  void set_keyboard(uint8_t buttons);
+
+private:
+  Controller &controller;
+  std::atomic<uint8_t> joystick{0x00};
+  std::atomic<uint8_t> keyboard{0x00};
+  std::atomic<bool> running{true};
+  std::thread thread;
+
+  void run();
+  void publish();
+};
+
+#endif